@@ -0,0 +1,155 @@
+#ifndef __lmdbpp_aggregate_h
+#define __lmdbpp_aggregate_h
+
+#include <lmdb.h>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include "lmdbpp.h"
+#include "iterators.h"
+
+namespace lmdbpp
+{
+
+// Aggregation kernels over contiguous spans, as yielded page by page by
+// MultiValIterator for DUPFIXED dbis. Loops are branch free with independent
+// accumulator lanes so the compiler can vectorize them (floating point sums
+// only vectorize this way, it may not reassociate a single accumulator).
+namespace kernels
+{
+
+constexpr size_t lanes = 8;
+
+template <typename T, typename TAcc = std::conditional_t<std::is_floating_point_v<T>, double, std::conditional_t<std::is_signed_v<T>, int64_t, uint64_t>>>
+TAcc sum(std::span<const T> vals)
+{
+    TAcc acc[lanes] = {};
+    size_t i = 0;
+    for (; i + lanes <= vals.size(); i += lanes)
+        for (size_t l = 0; l < lanes; ++l)
+            acc[l] += vals[i + l];
+    for (; i < vals.size(); ++i)
+        acc[0] += vals[i];
+    TAcc total = 0;
+    for (size_t l = 0; l < lanes; ++l)
+        total += acc[l];
+    return total;
+}
+
+// {min, max}, std::nullopt for an empty span
+template <typename T>
+std::optional<std::pair<T, T>> min_max(std::span<const T> vals)
+{
+    if (vals.empty())
+        return std::nullopt;
+    T lo[lanes], hi[lanes];
+    std::fill(std::begin(lo), std::end(lo), vals[0]);
+    std::fill(std::begin(hi), std::end(hi), vals[0]);
+    size_t i = 0;
+    for (; i + lanes <= vals.size(); i += lanes)
+    {
+        for (size_t l = 0; l < lanes; ++l)
+        {
+            lo[l] = vals[i + l] < lo[l] ? vals[i + l] : lo[l];
+            hi[l] = vals[i + l] > hi[l] ? vals[i + l] : hi[l];
+        }
+    }
+    for (; i < vals.size(); ++i)
+    {
+        lo[0] = vals[i] < lo[0] ? vals[i] : lo[0];
+        hi[0] = vals[i] > hi[0] ? vals[i] : hi[0];
+    }
+    return std::pair{*std::min_element(std::begin(lo), std::end(lo)), *std::max_element(std::begin(hi), std::end(hi))};
+}
+
+template <typename T, typename F>
+size_t count_if(std::span<const T> vals, F&& pred)
+{
+    size_t count[lanes] = {};
+    size_t i = 0;
+    for (; i + lanes <= vals.size(); i += lanes)
+        for (size_t l = 0; l < lanes; ++l)
+            count[l] += pred(vals[i + l]) ? 1 : 0;
+    for (; i < vals.size(); ++i)
+        count[0] += pred(vals[i]) ? 1 : 0;
+    size_t total = 0;
+    for (size_t l = 0; l < lanes; ++l)
+        total += count[l];
+    return total;
+}
+
+// adds every value to buckets of equal width starting at lo, values outside
+// [lo, lo + width * buckets.size()) are clamped into the first/last bucket
+template <typename T>
+void histogram(std::span<const T> vals, T lo, T width, std::span<uint64_t> buckets)
+{
+    if (buckets.empty())
+        return;
+    const double scale = 1.0 / (double)width, last = (double)(buckets.size() - 1);
+    for (const T& v : vals)
+    {
+        double b = std::clamp(((double)v - (double)lo) * scale, 0.0, last);
+        ++buckets[(size_t)b];
+    }
+}
+
+}  // namespace kernels
+
+// Folds the duplicates of key page by page with fn(acc, std::span<const TVal>)
+template <typename TVal, typename TKey, typename TAcc, typename F>
+TAcc fold_dups(Txn& txn, Dbi dbi, const Val<TKey>& key, TAcc acc, F&& fn)
+{
+    iterators::MultiValIterator<TKey, TVal> pages{txn, dbi, key};
+    for (auto& page : pages)
+        fn(acc, page);
+    return acc;
+}
+
+template <typename TVal, typename TKey>
+auto sum_dups(Txn& txn, Dbi dbi, const Val<TKey>& key)
+{
+    return fold_dups<TVal>(txn, dbi, key, decltype(kernels::sum(std::span<const TVal>{})){0}, [](auto& acc, std::span<const TVal> page)
+    {
+        acc += kernels::sum(page);
+    });
+}
+
+template <typename TVal, typename TKey>
+std::optional<std::pair<TVal, TVal>> min_max_dups(Txn& txn, Dbi dbi, const Val<TKey>& key)
+{
+    return fold_dups<TVal>(txn, dbi, key, std::optional<std::pair<TVal, TVal>>{}, [](auto& acc, std::span<const TVal> page)
+    {
+        auto mm = kernels::min_max(page);
+        if (!mm)
+            return;
+        if (!acc)
+            acc = mm;
+        else
+            acc = std::pair{std::min(acc->first, mm->first), std::max(acc->second, mm->second)};
+    });
+}
+
+template <typename TVal, typename TKey, typename F>
+size_t count_dups_if(Txn& txn, Dbi dbi, const Val<TKey>& key, F&& pred)
+{
+    return fold_dups<TVal>(txn, dbi, key, size_t{0}, [&pred](size_t& acc, std::span<const TVal> page)
+    {
+        acc += kernels::count_if(page, pred);
+    });
+}
+
+template <typename TVal, typename TKey>
+void histogram_dups(Txn& txn, Dbi dbi, const Val<TKey>& key, TVal lo, TVal width, std::span<uint64_t> buckets)
+{
+    iterators::MultiValIterator<TKey, TVal> pages{txn, dbi, key};
+    for (auto& page : pages)
+        kernels::histogram(page, lo, width, buckets);
+}
+
+}  // namespace lmdbpp
+
+#endif
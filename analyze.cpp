@@ -0,0 +1,91 @@
+#include <string>
+#include <string_view>
+#include <stdexcept>
+#include <cstdio>
+#include "lmdbpp.h"
+#include "stat.h"
+
+// Prints page usage of an LMDB environment, see analyze() in stat.h
+//
+//   analyze [--nosubdir] [--sample N] [--named] <path>
+//
+// --named also lists the named dbis, which takes a scan of the main dbi
+
+using namespace lmdbpp;
+
+void print_dbi(const DbiStats& d)
+{
+    std::printf("%-24s %6u %12zu %10zu %10zu %10zu %9.1f%% %9.1f%% %10.1f %10.1f\n",
+        d.name.empty() ? "(main)" : d.name.c_str(), d.depth, d.entries, d.branch_pages, d.leaf_pages, d.overflow_pages,
+        d.branch_fill * 100, d.leaf_fill * 100, d.avg_key_size, d.avg_val_size);
+}
+
+// a whole non-negative number, std::stoul alone takes "12ab" and "-1"
+bool parse_count(const char* s, size_t& out)
+{
+    try
+    {
+        size_t end;
+        unsigned long n = std::stoul(s, &end);
+        if (s[end] != '\0' || std::string_view{s}.find('-') != std::string_view::npos)
+            return false;
+        out = n;
+        return true;
+    }
+    catch (std::invalid_argument&) { return false; }
+    catch (std::out_of_range&) { return false; }
+}
+
+int main(int argc, char** argv)
+{
+    EnvArgs::Flags flags = EnvArgs::Flags::RDONLY;
+    AnalyzeArgs args;
+    const char* path = nullptr;
+    bool bad = false;
+    for (int i = 1; i < argc && !bad; ++i)
+    {
+        std::string_view arg{argv[i]};
+        if (arg == "--nosubdir")
+            flags = flags | EnvArgs::Flags::NOSUBDIR;
+        else if (arg == "--sample")
+            bad = i + 1 == argc || !parse_count(argv[++i], args.sample_entries);
+        else if (arg == "--named")
+            args.named_dbis = true;
+        else
+            path = argv[i];
+    }
+    if (path == nullptr || bad)
+    {
+        std::fprintf(stderr, "usage: %s [--nosubdir] [--sample N] [--named] <path>\n", argv[0]);
+        return 2;
+    }
+
+    try
+    {
+        Env env{path, {.flags=flags, .maxdbs=4096}};
+        EnvStats s = analyze(env, args);
+        double mb = 1024.0 * 1024.0;
+
+        std::printf("page size        %u\n", s.page_size);
+        std::printf("map              %.1f MB, %zu pages, %zu used (%.1f%%)\n", s.map_size / mb, s.map_pages, s.used_pages, s.map_used() * 100);
+        std::printf("freelist         %zu pages (%.1f MB) from %zu txns, %zu reusable\n",
+            s.free_pages, s.free_pages * s.page_size / mb, s.freelist_entries, s.reusable_free_pages);
+        std::printf("last txn         %zu\n", s.last_txnid);
+        std::printf("readers          %u of %u slots", s.num_readers, s.max_readers);
+        if (s.oldest_reader_txnid)
+            std::printf(", oldest on txn %zu (%zu behind)", s.oldest_reader_txnid, s.reader_lag());
+        std::printf("\n\n");
+
+        std::printf("%-24s %6s %12s %10s %10s %10s %10s %10s %10s %10s\n",
+            "dbi", "depth", "entries", "branch", "leaf", "overflow", "br.fill", "leaf.fill", "avg.key", "avg.val");
+        print_dbi(s.main);
+        for (const DbiStats& d : s.dbis)
+            print_dbi(d);
+    }
+    catch (Error& e)
+    {
+        std::fprintf(stderr, "%s: %s\n", path, e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,522 @@
+#ifndef __lmdbpp_async_h
+#define __lmdbpp_async_h
+
+#include <lmdb.h>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "lmdbpp.h"
+
+// C++20 coroutine front end: reads, writes and commits as awaitables, so one
+// event loop thread can drive many requests without blocking on the disk.
+//
+// Transactions never live across a suspension point. Every awaitable runs a
+// plain function inside one transaction on some thread and resumes the
+// awaiting coroutine afterwards, back on the executor it was running on.
+namespace lmdbpp
+{
+
+// Runs callbacks at some point on some thread. Derive from it to plug in the
+// event loop of your choice; the awaitables below resume coroutines on the
+// executor that is current on the thread they were awaited from.
+class Executor
+{
+public:
+    virtual ~Executor() = default;
+    virtual void post(std::function<void()> fn) = 0;
+
+    // executor running the calling thread's current callback, if any
+    static Executor* current() { return _current(); }
+
+protected:
+    // marks the calling thread as running callbacks of e while in scope
+    class Running
+    {
+    public:
+        Running(Executor* e) : _prev(std::exchange(_current(), e)) {}
+        ~Running() { _current() = _prev; }
+
+    private:
+        Executor* _prev;
+    };
+
+private:
+    static Executor*& _current()
+    {
+        thread_local Executor* e = nullptr;
+        return e;
+    }
+};
+
+// fixed number of threads working off one queue, the destructor runs what's
+// left in it before joining them
+class ThreadExecutor : public Executor
+{
+public:
+    ThreadExecutor(size_t threads = 1)
+    {
+        for (size_t i = 0; i < threads; ++i)
+            _threads.emplace_back([this] { _run(); });
+    }
+
+    ~ThreadExecutor()
+    {
+        {
+            std::lock_guard lock{_mutex};
+            _stop = true;
+        }
+        _cv.notify_all();
+        for (auto& t : _threads)
+            t.join();
+    }
+
+    ThreadExecutor(const ThreadExecutor&) = delete;
+    ThreadExecutor& operator=(const ThreadExecutor&) = delete;
+
+    void post(std::function<void()> fn) override
+    {
+        {
+            std::lock_guard lock{_mutex};
+            _queue.push_back(std::move(fn));
+        }
+        _cv.notify_one();
+    }
+
+    size_t threads() const { return _threads.size(); }
+
+private:
+    void _run()
+    {
+        Running running{this};
+        std::unique_lock lock{_mutex};
+        for (;;)
+        {
+            _cv.wait(lock, [this] { return _stop || !_queue.empty(); });
+            if (_queue.empty())
+                return;
+            auto fn = std::move(_queue.front());
+            _queue.pop_front();
+            lock.unlock();
+            fn();
+            lock.lock();
+        }
+    }
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::deque<std::function<void()>> _queue;
+    bool _stop = false;
+    std::vector<std::thread> _threads;
+};
+
+template <typename T>
+class Task;
+
+namespace detail
+{
+struct TaskPromiseBase
+{
+    std::coroutine_handle<> continuation = std::noop_coroutine();
+    std::exception_ptr error;
+
+    // hands over to whoever awaited the task
+    struct Final
+    {
+        bool await_ready() noexcept { return false; }
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept { return h.promise().continuation; }
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    Final final_suspend() noexcept { return {}; }
+    void unhandled_exception() { error = std::current_exception(); }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase
+{
+    std::optional<T> value;
+
+    template <typename U>
+    void return_value(U&& v) { value.emplace(std::forward<U>(v)); }
+
+    T result()
+    {
+        if (error)
+            std::rethrow_exception(error);
+        return std::move(*value);
+    }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase
+{
+    void return_void() {}
+
+    void result()
+    {
+        if (error)
+            std::rethrow_exception(error);
+    }
+};
+
+// fire and forget coroutine, starts suspended and frees itself when done
+struct Detached
+{
+    struct promise_type
+    {
+        Detached get_return_object() { return {std::coroutine_handle<promise_type>::from_promise(*this)}; }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+// Awaitable running fn() on ex and resuming the awaiting coroutine on the
+// executor it was awaited from, or right on ex's thread if there is none
+template <typename F>
+class RunOn
+{
+public:
+    typedef std::invoke_result_t<F&> result_type;
+
+    RunOn(Executor& ex, F fn) : _ex(ex), _fn(std::move(fn)) {}
+
+    bool await_ready() { return false; }
+
+    void await_suspend(std::coroutine_handle<> h)
+    {
+        Executor* home = Executor::current();
+        _ex.post([this, h, home]
+        {
+            try
+            {
+                if constexpr (std::is_void_v<result_type>)
+                    _fn();
+                else
+                    _result.emplace(_fn());
+            }
+            catch (...)
+            {
+                _error = std::current_exception();
+            }
+            if (home != nullptr && home != &_ex)
+                home->post([h] { h.resume(); });
+            else
+                h.resume();
+        });
+    }
+
+    result_type await_resume()
+    {
+        if (_error)
+            std::rethrow_exception(_error);
+        if constexpr (!std::is_void_v<result_type>)
+            return std::move(*_result);
+    }
+
+private:
+    typedef std::conditional_t<std::is_void_v<result_type>, char, result_type> stored_type;
+
+    Executor& _ex;
+    F _fn;
+    std::optional<stored_type> _result;
+    std::exception_ptr _error;
+};
+}  // namespace detail
+
+// Lazily started coroutine returning T: the body runs once the task is
+// co_await'ed (or handed to sync_wait() or EventLoop::spawn())
+template <typename T = void>
+class Task
+{
+public:
+    struct promise_type : detail::TaskPromise<T>
+    {
+        Task get_return_object() { return Task{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+    };
+
+    Task(Task&& o) : _h(std::exchange(o._h, nullptr)) {}
+
+    Task& operator=(Task&& o)
+    {
+        if (this != &o)
+        {
+            if (_h)
+                _h.destroy();
+            _h = std::exchange(o._h, nullptr);
+        }
+        return *this;
+    }
+
+    ~Task()
+    {
+        if (_h)
+            _h.destroy();
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    auto operator co_await()
+    {
+        struct Awaiter
+        {
+            std::coroutine_handle<promise_type> h;
+
+            bool await_ready() { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting)
+            {
+                h.promise().continuation = awaiting;
+                return h;
+            }
+            T await_resume() { return h.promise().result(); }
+        };
+        return Awaiter{_h};
+    }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> h) : _h(h) {}
+
+    std::coroutine_handle<promise_type> _h;
+};
+
+// Runs task to completion and blocks the calling thread until it's done, for
+// callers outside of coroutines
+template <typename T>
+T sync_wait(Task<T> task)
+{
+    auto drive = [](Task<T> task, std::promise<T> done) -> detail::Detached
+    {
+        try
+        {
+            if constexpr (std::is_void_v<T>)
+            {
+                co_await task;
+                done.set_value();
+            }
+            else
+            {
+                done.set_value(co_await task);
+            }
+        }
+        catch (...)
+        {
+            done.set_exception(std::current_exception());
+        }
+    };
+    std::promise<T> done;
+    auto future = done.get_future();
+    drive(std::move(task), std::move(done)).handle.resume();
+    return future.get();
+}
+
+// Minimal single threaded event loop: run() works off posted callbacks on
+// the calling thread until every spawned task has finished.
+class EventLoop : public Executor
+{
+public:
+    EventLoop() = default;
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    void post(std::function<void()> fn) override
+    {
+        {
+            std::lock_guard lock{_mutex};
+            _queue.push_back(std::move(fn));
+        }
+        _cv.notify_one();
+    }
+
+    // starts task on the loop with the next run()
+    void spawn(Task<void> task)
+    {
+        {
+            std::lock_guard lock{_mutex};
+            ++_tasks;
+        }
+        auto h = _drive(std::move(task)).handle;
+        post([h] { h.resume(); });
+    }
+
+    // returns once all spawned tasks finished, rethrows the first exception one ended with
+    void run()
+    {
+        Running running{this};
+        std::unique_lock lock{_mutex};
+        for (;;)
+        {
+            _cv.wait(lock, [this] { return _tasks == 0 || !_queue.empty(); });
+            if (_queue.empty())
+                break;
+            auto fn = std::move(_queue.front());
+            _queue.pop_front();
+            lock.unlock();
+            fn();
+            lock.lock();
+        }
+        if (_error)
+            std::rethrow_exception(std::exchange(_error, nullptr));
+    }
+
+private:
+    detail::Detached _drive(Task<void> task)
+    {
+        std::exception_ptr error;
+        try
+        {
+            co_await task;
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        {
+            std::lock_guard lock{_mutex};
+            if (error && !_error)
+                _error = error;
+            --_tasks;
+        }
+        _cv.notify_one();
+    }
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::deque<std::function<void()>> _queue;
+    size_t _tasks = 0;
+    std::exception_ptr _error;
+};
+
+struct AsyncArgs
+{
+    size_t reader_threads = 0;      // threads running reads, 0 to run them inline on the awaiting thread
+    size_t max_idle_readers = 16;   // parked read-only transactions, see ReadTxnPool
+};
+
+// Awaitable access to an Env. Write transactions all run on one writer
+// thread, which is the only one ever waiting for LMDB's write lock or an
+// fsync; reads renew pooled read-only transactions, either inline (they
+// don't block on anything but page faults) or on reader threads.
+//
+// The functions passed to read() and write() run inside the transaction and
+// must not keep pointers into it: what they return has to own its data.
+class AsyncEnv
+{
+public:
+    AsyncEnv(Env& env, AsyncArgs args = AsyncArgs{})
+        : _env(env)
+        , _pool(env, args.max_idle_readers)
+    {
+        if (args.reader_threads > 0)
+            _readers = std::make_unique<ThreadExecutor>(args.reader_threads);
+    }
+
+    AsyncEnv(const AsyncEnv&) = delete;
+    AsyncEnv& operator=(const AsyncEnv&) = delete;
+
+    // fn(ReadOnlyTxn&), retried after adopting a map size another process grew the map to
+    template <typename F>
+    Task<std::invoke_result_t<F&, ReadOnlyTxn&>> read(F fn)
+    {
+        auto run = [this, &fn]
+        {
+            for (;;)
+            {
+                try
+                {
+                    ReadTxn txn{_pool};
+                    return fn(static_cast<ReadOnlyTxn&>(txn));
+                }
+                catch (MapResizedError&)
+                {
+                    if (!_env.adopt_mapsize())
+                        throw;
+                }
+            }
+        };
+        if (_readers)
+            co_return co_await detail::RunOn{*_readers, run};
+        co_return run();
+    }
+
+    // fn(WriteTxn&) on the writer thread, completes once the transaction is
+    // committed, see with_write_txn()
+    template <typename F>
+    Task<std::invoke_result_t<F&, WriteTxn&>> write(F fn)
+    {
+        co_return co_await detail::RunOn{_writer, [this, &fn] { return with_write_txn<WriteTxn>(_env, fn); }};
+    }
+
+    Task<std::optional<std::string>> get(Dbi dbi, std::string key)
+    {
+        co_return co_await read([&](ReadOnlyTxn& txn) -> std::optional<std::string>
+        {
+            auto val = txn.try_get<const char, char>(dbi, Val<const char>{key});
+            if (!val)
+                return std::nullopt;
+            return val->to_str();
+        });
+    }
+
+    // see Txn::get_many(), results are in the order of keys
+    Task<std::vector<std::optional<std::string>>> get_many(Dbi dbi, std::vector<std::string> keys)
+    {
+        co_return co_await read([&](ReadOnlyTxn& txn)
+        {
+            std::vector<Val<const char>> in(keys.begin(), keys.end());
+            std::vector<Val<const char>> out(keys.size());
+            txn.get_many<const char, char>(dbi, in, out);
+            std::vector<std::optional<std::string>> vals(keys.size());
+            for (size_t i = 0; i < out.size(); ++i)
+            {
+                if (out[i].data() != nullptr)
+                    vals[i] = out[i].to_str();
+            }
+            return vals;
+        });
+    }
+
+    Task<void> put(Dbi dbi, std::string key, std::string val)
+    {
+        co_await write([&](WriteTxn& txn) { txn.put(dbi, Val<const char>{key}, Val<const char>{val}); });
+    }
+
+    Task<void> overwrite(Dbi dbi, std::string key, std::string val)
+    {
+        co_await write([&](WriteTxn& txn) { txn.overwrite(dbi, Val<const char>{key}, Val<const char>{val}); });
+    }
+
+    Task<void> del(Dbi dbi, std::string key)
+    {
+        co_await write([&](WriteTxn& txn) { txn.del(dbi, Val<const char>{key}); });
+    }
+
+    Env& env() const { return _env; }
+    Executor& writer() { return _writer; }
+
+private:
+    Env& _env;
+    ReadTxnPool _pool;
+    ThreadExecutor _writer{1};
+    std::unique_ptr<ThreadExecutor> _readers;
+};
+
+}  // namespace lmdbpp
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef __lmdbpp_backup_h
+#define __lmdbpp_backup_h
+
+#include <lmdb.h>
+#include <cerrno>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <span>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include "lmdbpp.h"
+
+namespace lmdbpp
+{
+
+struct BackupProgress
+{
+    uint64_t bytes = 0;             // written so far
+    uint64_t expected = 0;          // upper bound for the total, the map's high water mark
+    std::chrono::nanoseconds elapsed{0};
+};
+
+struct BackupArgs
+{
+    bool compact = true;                    // MDB_CP_COMPACT: skip free pages, renumber the rest
+    uint64_t bytes_per_sec = 0;             // throttle, 0 for none
+    size_t chunk_size = 1024 * 1024;        // granularity of throttling and progress
+    std::function<void(const BackupProgress&)> progress{};   // called after every chunk
+};
+
+// Copies env with mdb_env_copyfd2 into a pipe and moves it on to sink(chunk)
+// from the calling thread, so the copy can be throttled and observed. LMDB
+// blocks on the full pipe, the pace of the sink is the pace of the copy.
+//
+// The copy holds a read-only transaction for its whole duration, a slow
+// throttle keeps the pages it sees from being reused for as long. If sink
+// throws, the pipe is closed and the copy fails with EPIPE instead of
+// running to the end, the sink's exception is rethrown.
+inline BackupProgress backup(Env& env, const std::function<void(std::span<const char>)>& sink, BackupArgs args = BackupArgs{})
+{
+    typedef std::chrono::steady_clock clock;
+
+    int fds[2];
+    if (::pipe(fds) != 0)
+        throw std::system_error(errno, std::generic_category(), "backup: pipe");
+
+    BackupProgress progress;
+    MDB_envinfo info = env.info();
+    progress.expected = (info.me_last_pgno + 1) * env.stat().ms_psize;
+
+    int rc = 0;
+    std::thread copier([&]
+    {
+        // writes into the pipe once it's closed fail with EPIPE rather than
+        // kill the process, threads LMDB starts for the copy inherit the mask
+        sigset_t sigpipe;
+        sigemptyset(&sigpipe);
+        sigaddset(&sigpipe, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &sigpipe, nullptr);
+        rc = mdb_env_copyfd2(env.mdb_env(), fds[1], args.compact ? MDB_CP_COMPACT : 0);
+        ::close(fds[1]);
+        // the SIGPIPE raised by a failed write is pending, take it back
+        if (rc == EPIPE)
+        {
+            timespec now{};
+            sigtimedwait(&sigpipe, nullptr, &now);
+        }
+    });
+
+    std::vector<char> buf(args.chunk_size);
+    std::exception_ptr error;
+    auto start = clock::now();
+    for (;;)
+    {
+        ssize_t n = ::read(fds[0], buf.data(), buf.size());
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+        {
+            if (!error)
+                error = std::make_exception_ptr(std::system_error(errno, std::generic_category(), "backup: read"));
+            break;
+        }
+        if (n == 0)
+            break;
+        try
+        {
+            sink({buf.data(), (size_t)n});
+            progress.bytes += n;
+            if (args.bytes_per_sec > 0)
+                std::this_thread::sleep_until(start + std::chrono::nanoseconds(progress.bytes * 1000000000ull / args.bytes_per_sec));
+            progress.elapsed = clock::now() - start;
+            if (args.progress)
+                args.progress(progress);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+            break;
+        }
+    }
+    // stops a copy still running, see above
+    ::close(fds[0]);
+    copier.join();
+    if (error)
+        std::rethrow_exception(error);
+    check(rc);
+    return progress;
+}
+
+// backs up into an open file descriptor, e.g. a pipe to a compressor
+inline BackupProgress backup(Env& env, int fd, BackupArgs args = BackupArgs{})
+{
+    return backup(env, [fd](std::span<const char> chunk)
+    {
+        while (!chunk.empty())
+        {
+            ssize_t n = ::write(fd, chunk.data(), chunk.size());
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                throw std::system_error(errno, std::generic_category(), "backup: write");
+            chunk = chunk.subspan(n);
+        }
+    }, std::move(args));
+}
+
+// Backs up into a new environment at path, laid out like mdb_env_copy2
+// does: path/data.mdb, or the file path itself for a MDB_NOSUBDIR env
+inline BackupProgress backup(Env& env, const std::string& path, BackupArgs args = BackupArgs{})
+{
+    bool nosubdir = (env.flags() & EnvArgs::Flags::NOSUBDIR) != EnvArgs::Flags::NONE;
+    std::string file = nosubdir ? path : path + "/data.mdb";
+    int fd = ::open(file.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0)
+        throw std::system_error(errno, std::generic_category(), "backup: " + file);
+    try
+    {
+        BackupProgress progress = backup(env, fd, std::move(args));
+        if (::fsync(fd) != 0)
+            throw std::system_error(errno, std::generic_category(), "backup: fsync");
+        ::close(fd);
+        return progress;
+    }
+    catch (...)
+    {
+        ::close(fd);
+        ::unlink(file.c_str());
+        throw;
+    }
+}
+
+}  // namespace lmdbpp
+
+#endif
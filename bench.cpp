@@ -0,0 +1,551 @@
+#include <vector>
+#include <string>
+#include <string_view>
+#include <filesystem>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <numeric>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include "lmdbpp.h"
+#include "iterators.h"
+#include "codec.h"
+
+// Every workload runs once through the raw mdb_* API and once through lmdbpp,
+// on a fresh environment, and reports throughput, per-op latency percentiles
+// and the bytes handed to write(2)/pwrite(2) while it ran.
+//
+//   bench [filter] [scale]
+//
+// runs the workloads whose name contains filter, scale multiplies the op counts.
+
+using namespace lmdbpp;
+using namespace lmdbpp::iterators;
+
+typedef std::chrono::steady_clock bench_clock;
+
+const std::string env_path{"bench.mdb"};
+size_t key_count = 100000;
+size_t dup_keys = 100;
+size_t dups_per_key = 1000;
+const size_t batch = 1000;      // writes per write transaction
+
+struct Result
+{
+    uint64_t ops = 0;
+    double secs = 0;
+    uint64_t written = 0;
+    std::vector<uint64_t> ns;   // per op latencies
+};
+
+// bytes passed to write syscalls by this process so far (Linux only, 0 elsewhere)
+uint64_t bytes_written()
+{
+    std::ifstream io{"/proc/self/io"};
+    std::string field;
+    uint64_t value;
+    while (io >> field >> value)
+        if (field == "wchar:")
+            return value;
+    return 0;
+}
+
+void report(const char* workload, const char* api, unsigned threads, Result& r)
+{
+    std::sort(r.ns.begin(), r.ns.end());
+    auto pct = [&r](double p) { return r.ns.empty() ? 0.0 : (double)r.ns[std::min(r.ns.size() - 1, (size_t)(p * r.ns.size()))]; };
+    std::printf("%-22s %-7s thr=%-3u %12.0f ops/s  p50 %8.0f ns  p99 %8.0f ns  p99.9 %9.0f ns  written %9.1f MB\n",
+        workload, api, threads, r.ops / r.secs, pct(0.5), pct(0.99), pct(0.999), r.written / (1024.0 * 1024.0));
+    std::fflush(stdout);
+}
+
+// runs op(thread, i) for i in [0, ops) on each of `threads` threads, timing every call
+template <typename F>
+Result measure(unsigned threads, size_t ops, F&& op)
+{
+    Result r;
+    std::vector<std::vector<uint64_t>> samples(threads);
+    std::vector<std::thread> workers;
+    uint64_t written = bytes_written();
+    auto start = bench_clock::now();
+    for (unsigned t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&, t]
+        {
+            auto& ns = samples[t];
+            ns.reserve(ops);
+            for (size_t i = 0; i < ops; ++i)
+            {
+                auto before = bench_clock::now();
+                op(t, i);
+                ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - before).count());
+            }
+        });
+    }
+    for (auto& w : workers)
+        w.join();
+    r.secs = std::chrono::duration<double>(bench_clock::now() - start).count();
+    r.written = bytes_written() - written;
+    for (auto& s : samples)
+        r.ns.insert(r.ns.end(), s.begin(), s.end());
+    r.ops = r.ns.size();
+    return r;
+}
+
+// an empty env at env_path/name, any other open env has to use another name
+Env fresh_env(EnvArgs::Flags flags = EnvArgs::Flags::NOSYNC, const std::string& name = "main")
+{
+    std::string path = env_path + "/" + name;
+    std::filesystem::remove_all(path);
+    std::filesystem::create_directories(path);
+    return Env{path, {.flags=EnvArgs::Flags::CREATE | flags, .mapsize=1024ul*1024*1024}};
+}
+
+// big-endian so that sequential ids are sequential in the btree as well
+uint64_t key_of(uint64_t i)
+{
+    uint64_t k;
+    Codec<uint64_t>::encode(i, (char*)&k, true);
+    return k;
+}
+
+std::vector<uint64_t> key_order(bool random)
+{
+    std::vector<uint64_t> keys(key_count);
+    std::iota(keys.begin(), keys.end(), 0);
+    if (random)
+        std::shuffle(keys.begin(), keys.end(), std::mt19937_64{42});
+    for (auto& k : keys)
+        k = key_of(k);
+    return keys;
+}
+
+Dbi fill(Env& env)
+{
+    Txn txn{env};
+    Dbi dbi = txn.open_dbi();
+    for (uint64_t k : key_order(false))
+        txn.append(dbi, Val{&k}, Val{&k});
+    return dbi;
+}
+
+Dbi fill_dups(Env& env)
+{
+    Txn txn{env};
+    Dbi dbi = txn.open_dbi(nullptr, DbiFlags::DUPSORT | DbiFlags::DUPFIXED);
+    std::vector<uint64_t> vals(dups_per_key);
+    std::iota(vals.begin(), vals.end(), 0);
+    Cursor c{txn, dbi};
+    for (uint64_t i = 0; i < dup_keys; ++i)
+    {
+        uint64_t k = key_of(i);
+        c.put(Val{&k}, MultiVal<uint64_t>{vals});
+    }
+    return dbi;
+}
+
+void put(bool random)
+{
+    const char* name = random ? "put_rand" : "put_seq";
+    auto keys = key_order(random);
+    {
+        Env env = fresh_env();
+        MDB_txn* txn = nullptr;
+        MDB_dbi dbi;
+        Result r = measure(1, keys.size(), [&](unsigned, size_t i)
+        {
+            if (txn == nullptr)
+            {
+                mdb_txn_begin(env.mdb_env(), nullptr, 0, &txn);
+                mdb_dbi_open(txn, nullptr, 0, &dbi);
+            }
+            MDB_val k{sizeof(uint64_t), &keys[i]}, v{sizeof(uint64_t), &keys[i]};
+            mdb_put(txn, dbi, &k, &v, MDB_NOOVERWRITE);
+            if ((i + 1) % batch == 0 || i + 1 == keys.size())
+            {
+                mdb_txn_commit(txn);
+                txn = nullptr;
+            }
+        });
+        report(name, "raw", 1, r);
+    }
+    {
+        Env env = fresh_env();
+        std::optional<Txn> txn;
+        Dbi dbi;
+        Result r = measure(1, keys.size(), [&](unsigned, size_t i)
+        {
+            if (!txn)
+            {
+                txn.emplace(env);
+                dbi = txn->open_dbi();
+            }
+            txn->put(dbi, Val{&keys[i]}, Val{&keys[i]});
+            if ((i + 1) % batch == 0 || i + 1 == keys.size())
+            {
+                txn->commit();
+                txn.reset();
+            }
+        });
+        report(name, "lmdbpp", 1, r);
+    }
+}
+
+void get(bool random)
+{
+    const char* name = random ? "get_rand" : "get_seq";
+    auto keys = key_order(random);
+    Env env = fresh_env();
+    Dbi dbi = fill(env);
+    {
+        MDB_txn* txn;
+        mdb_txn_begin(env.mdb_env(), nullptr, MDB_RDONLY, &txn);
+        Result r = measure(1, keys.size(), [&](unsigned, size_t i)
+        {
+            MDB_val k{sizeof(uint64_t), &keys[i]}, v;
+            mdb_get(txn, dbi, &k, &v);
+        });
+        mdb_txn_abort(txn);
+        report(name, "raw", 1, r);
+    }
+    {
+        Txn txn{env, MDB_RDONLY};
+        Result r = measure(1, keys.size(), [&](unsigned, size_t i)
+        {
+            txn.get<uint64_t, uint64_t>(dbi, Val{&keys[i]});
+        });
+        report(name, "lmdbpp", 1, r);
+    }
+}
+
+// one op is one step of the scan
+void scan()
+{
+    Env env = fresh_env();
+    Dbi dbi = fill(env);
+    const size_t passes = 10;
+    {
+        MDB_txn* txn;
+        MDB_cursor* c;
+        mdb_txn_begin(env.mdb_env(), nullptr, MDB_RDONLY, &txn);
+        mdb_cursor_open(txn, dbi, &c);
+        MDB_val k, v;
+        Result r = measure(1, passes * key_count, [&](unsigned, size_t i)
+        {
+            mdb_cursor_get(c, &k, &v, i % key_count == 0 ? MDB_FIRST : MDB_NEXT);
+        });
+        mdb_cursor_close(c);
+        mdb_txn_abort(txn);
+        report("scan", "raw", 1, r);
+    }
+    {
+        Txn txn{env, MDB_RDONLY};
+        std::optional<KeyValIterator<uint64_t, uint64_t>> range;
+        std::optional<decltype(range->begin())> it;
+        Result r = measure(1, passes * key_count, [&](unsigned, size_t i)
+        {
+            if (i % key_count == 0)
+            {
+                it.reset();
+                range.emplace(txn, dbi);
+                it.emplace(range->begin());
+            }
+            else
+            {
+                ++*it;
+            }
+        });
+        report("scan_keyval", "lmdbpp", 1, r);
+    }
+    {
+        Txn txn{env, MDB_RDONLY};
+        std::optional<KeyRange<uint64_t, uint64_t>> range;
+        KeyRange<uint64_t, uint64_t>::iterator it;
+        Result r = measure(1, passes * key_count, [&](unsigned, size_t i)
+        {
+            if (i % key_count == 0)
+            {
+                range.emplace(KeyRange<uint64_t, uint64_t>::all(txn, dbi));
+                it = range->begin();
+            }
+            else
+            {
+                ++it;
+            }
+        });
+        report("scan_keyrange", "lmdbpp", 1, r);
+    }
+}
+
+// one op is one MDB_MULTIPLE put of dups_per_key values
+void put_multiple()
+{
+    std::vector<uint64_t> vals(dups_per_key);
+    std::iota(vals.begin(), vals.end(), 0);
+    {
+        Env env = fresh_env();
+        MDB_txn* txn;
+        MDB_dbi dbi;
+        MDB_cursor* c;
+        mdb_txn_begin(env.mdb_env(), nullptr, 0, &txn);
+        mdb_dbi_open(txn, nullptr, MDB_DUPSORT | MDB_DUPFIXED, &dbi);
+        mdb_cursor_open(txn, dbi, &c);
+        Result r = measure(1, dup_keys, [&](unsigned, size_t i)
+        {
+            uint64_t key = key_of(i);
+            MDB_val k{sizeof(key), &key};
+            MDB_val v[2] = {{sizeof(uint64_t), vals.data()}, {vals.size(), nullptr}};
+            mdb_cursor_put(c, &k, v, MDB_MULTIPLE);
+        });
+        mdb_cursor_close(c);
+        mdb_txn_commit(txn);
+        report("put_multiple", "raw", 1, r);
+    }
+    {
+        Env env = fresh_env();
+        Txn txn{env};
+        Dbi dbi = txn.open_dbi(nullptr, DbiFlags::DUPSORT | DbiFlags::DUPFIXED);
+        Cursor c{txn, dbi};
+        MultiVal<uint64_t> mv{vals};
+        Result r = measure(1, dup_keys, [&](unsigned, size_t i)
+        {
+            uint64_t key = key_of(i);
+            c.put(Val{&key}, mv);
+        });
+        txn.commit();
+        report("put_multiple", "lmdbpp", 1, r);
+    }
+}
+
+void dup_iteration()
+{
+    Env env = fresh_env();
+    Dbi dbi = fill_dups(env);
+    Txn txn{env, MDB_RDONLY};
+    uint64_t key = key_of(dup_keys / 2);
+
+    // one op is one duplicate
+    {
+        MDB_cursor* c;
+        mdb_cursor_open(txn.mdb_txn(), dbi, &c);
+        MDB_val k{sizeof(key), &key}, v;
+        Result r = measure(1, 100 * dups_per_key, [&](unsigned, size_t i)
+        {
+            mdb_cursor_get(c, &k, &v, i % dups_per_key == 0 ? MDB_SET_KEY : MDB_NEXT_DUP);
+        });
+        mdb_cursor_close(c);
+        report("dup_iter", "raw", 1, r);
+    }
+    {
+        Val<const uint64_t> k{&key};
+        std::optional<DupValIterator<const uint64_t, uint64_t>> dups;
+        std::optional<decltype(dups->begin())> it;
+        Result r = measure(1, 100 * dups_per_key, [&](unsigned, size_t i)
+        {
+            if (i % dups_per_key == 0)
+            {
+                it.reset();
+                dups.emplace(txn, dbi, k);
+                it.emplace(dups->begin());
+            }
+            else
+            {
+                ++*it;
+            }
+        });
+        report("dup_iter", "lmdbpp", 1, r);
+    }
+
+    // one op is all duplicates of the key, a page at a time
+    {
+        MDB_cursor* c;
+        mdb_cursor_open(txn.mdb_txn(), dbi, &c);
+        uint64_t sum = 0;
+        Result r = measure(1, 1000, [&](unsigned, size_t)
+        {
+            MDB_val k{sizeof(key), &key}, v;
+            if (mdb_cursor_get(c, &k, &v, MDB_SET_KEY) != 0 || mdb_cursor_get(c, &k, &v, MDB_GET_MULTIPLE) != 0)
+                return;
+            do
+                sum += v.mv_size / sizeof(uint64_t);
+            while (mdb_cursor_get(c, &k, &v, MDB_NEXT_MULTIPLE) == 0);
+        });
+        mdb_cursor_close(c);
+        report("dup_pages", "raw", 1, r);
+    }
+    {
+        Val<const uint64_t> k{&key};
+        uint64_t sum = 0;
+        Result r = measure(1, 1000, [&](unsigned, size_t)
+        {
+            MultiValIterator<const uint64_t, uint64_t> pages{txn, dbi, k};
+            for (auto& page : pages)
+                sum += page.size();
+        });
+        report("dup_pages", "lmdbpp", 1, r);
+    }
+}
+
+void txn_costs()
+{
+    Env env = fresh_env();
+    fill(env);
+    const size_t ops = 100000;
+
+    Result r = measure(1, ops, [&](unsigned, size_t)
+    {
+        MDB_txn* txn;
+        mdb_txn_begin(env.mdb_env(), nullptr, MDB_RDONLY, &txn);
+        mdb_txn_abort(txn);
+    });
+    report("txn_read", "raw", 1, r);
+    r = measure(1, ops, [&](unsigned, size_t)
+    {
+        Txn txn{env, MDB_RDONLY};
+    });
+    report("txn_read", "lmdbpp", 1, r);
+    {
+        MDB_txn* txn;
+        mdb_txn_begin(env.mdb_env(), nullptr, MDB_RDONLY, &txn);
+        mdb_txn_reset(txn);
+        r = measure(1, ops, [&](unsigned, size_t)
+        {
+            mdb_txn_renew(txn);
+            mdb_txn_reset(txn);
+        });
+        mdb_txn_abort(txn);
+        report("txn_read_renew", "raw", 1, r);
+    }
+    {
+        ReadTxnPool pool{env};
+        r = measure(1, ops, [&](unsigned, size_t)
+        {
+            ReadTxn txn{pool};
+        });
+        report("txn_read_renew", "lmdbpp", 1, r);
+    }
+
+    // a single put per write transaction, without and with fsync on commit
+    for (auto flags : {EnvArgs::Flags::NOSYNC, EnvArgs::Flags::NONE})
+    {
+        const char* name = flags == EnvArgs::Flags::NONE ? "txn_write_sync" : "txn_write";
+        size_t n = flags == EnvArgs::Flags::NONE ? 1000 : ops;
+        Env wenv = fresh_env(flags, "write");
+        Dbi wdbi;
+        {
+            Txn txn{wenv};
+            wdbi = txn.open_dbi();
+        }
+        r = measure(1, n, [&](unsigned, size_t i)
+        {
+            uint64_t k = key_of(i);
+            MDB_txn* txn;
+            mdb_txn_begin(wenv.mdb_env(), nullptr, 0, &txn);
+            MDB_val key{sizeof(k), &k}, val{sizeof(k), &k};
+            mdb_put(txn, wdbi, &key, &val, 0);
+            mdb_txn_commit(txn);
+        });
+        report(name, "raw", 1, r);
+        r = measure(1, n, [&](unsigned, size_t i)
+        {
+            uint64_t k = key_of(i);
+            Txn txn{wenv};
+            txn.overwrite(wdbi, Val{&k}, Val{&k});
+        });
+        report(name, "lmdbpp", 1, r);
+    }
+}
+
+// random point reads from 1..N threads, while a writer keeps committing batches
+void concurrency()
+{
+    Env env = fresh_env();
+    Dbi dbi = fill(env);
+    auto keys = key_order(true);
+    unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+    const size_t ops = 200000;
+
+    for (unsigned threads = 1; threads <= max_threads; threads *= 2)
+    {
+        for (bool raw : {true, false})
+        {
+            std::atomic<bool> stop{false};
+            std::atomic<uint64_t> writes{0};
+            std::thread writer([&]
+            {
+                for (uint64_t i = 0; !stop; )
+                {
+                    Txn txn{env};
+                    for (size_t b = 0; b < batch; ++b, ++i)
+                        txn.overwrite(dbi, Val{&keys[i % key_count]}, Val{&i});
+                    txn.commit();
+                    writes += batch;
+                }
+            });
+
+            Result r;
+            if (raw)
+            {
+                std::vector<MDB_txn*> txns(threads, nullptr);
+                r = measure(threads, ops, [&](unsigned t, size_t i)
+                {
+                    // a fresh snapshot every op, the same as lmdbpp below
+                    if (txns[t] == nullptr)
+                        mdb_txn_begin(env.mdb_env(), nullptr, MDB_RDONLY, &txns[t]);
+                    else
+                        mdb_txn_renew(txns[t]);
+                    MDB_val k{sizeof(uint64_t), &keys[(i * 7919 + t) % key_count]}, v;
+                    mdb_get(txns[t], dbi, &k, &v);
+                    mdb_txn_reset(txns[t]);
+                });
+                for (MDB_txn* txn : txns)
+                    mdb_txn_abort(txn);
+            }
+            else
+            {
+                ReadTxnPool pool{env, threads};
+                r = measure(threads, ops, [&](unsigned t, size_t i)
+                {
+                    ReadTxn txn{pool};
+                    txn.get<uint64_t, uint64_t>(dbi, Val{&keys[(i * 7919 + t) % key_count]});
+                });
+            }
+            stop = true;
+            writer.join();
+            report("concurrent_get", raw ? "raw" : "lmdbpp", threads, r);
+            std::printf("%-22s %-7s thr=%-3u %12.0f writes/s\n", "  background writer", "", threads, writes / r.secs);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string_view filter = argc > 1 ? argv[1] : "";
+    double scale = argc > 2 ? std::atof(argv[2]) : 1.0;
+    key_count = std::max<size_t>(batch, key_count * scale);
+    dup_keys = std::max<size_t>(1, dup_keys * scale);
+
+    struct Workload { const char* name; void (*run)(); };
+    Workload workloads[] = {
+        {"put_seq", [] { put(false); }},
+        {"put_rand", [] { put(true); }},
+        {"get_seq", [] { get(false); }},
+        {"get_rand", [] { get(true); }},
+        {"scan", scan},
+        {"put_multiple", put_multiple},
+        {"dup_iteration", dup_iteration},
+        {"txn", txn_costs},
+        {"concurrency", concurrency},
+    };
+    for (auto& w : workloads)
+        if (std::string_view{w.name}.find(filter) != std::string_view::npos)
+            w.run();
+    std::filesystem::remove_all(env_path);
+
+    return 0;
+}
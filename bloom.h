@@ -0,0 +1,194 @@
+#ifndef __lmdbpp_bloom_h
+#define __lmdbpp_bloom_h
+
+#include <lmdb.h>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lmdbpp
+{
+
+// Blocked Bloom filter: every key sets its bits within one 64 byte block, so
+// a lookup costs one cache miss however many hash functions there are. Safe
+// to add to and query from any number of threads at once.
+//
+// No false negatives: a key it says is missing never was added. Keys can't be
+// removed, removed() only counts them, their bits turn into false positives.
+class BloomFilter
+{
+public:
+    static constexpr size_t block_words = 8;
+    static constexpr size_t block_bits = block_words * 64;
+
+    // sized for `keys` keys at `bits_per_key`, about 1% false positives at 10
+    BloomFilter(size_t keys, double bits_per_key = 10)
+        : _blocks(std::max<size_t>(1, (size_t)std::ceil(std::max<size_t>(keys, 1) * bits_per_key / block_bits)))
+        , _hashes(std::clamp((int)std::lround(bits_per_key * 0.69), 1, 16))
+        , _capacity(std::max<size_t>(keys, 1))
+        , _words(new std::atomic<uint64_t>[_blocks * block_words]{})
+    {
+    }
+
+    BloomFilter(const BloomFilter&) = delete;
+    BloomFilter& operator=(const BloomFilter&) = delete;
+
+    static uint64_t hash(const void* data, size_t size)
+    {
+        // FNV-1a, then a splitmix64 finalizer to spread the bits FNV leaves weak
+        uint64_t h = 14695981039346656037ull;
+        for (size_t i = 0; i < size; ++i)
+            h = (h ^ ((const unsigned char*)data)[i]) * 1099511628211ull;
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+        return h ^ (h >> 31);
+    }
+
+    // Bits are set before the write they stand for is committed and read
+    // after a reader's snapshot is taken, seq_cst keeps the two in that order
+    // on any architecture (it costs nothing extra for loads on x86)
+    void add(const MDB_val* key)
+    {
+        _probe(key, [](std::atomic<uint64_t>& word, uint64_t bit) { word.fetch_or(bit); return true; });
+        ++_added;
+    }
+
+    bool may_contain(const MDB_val* key) const
+    {
+        return _probe(key, [](std::atomic<uint64_t>& word, uint64_t bit) { return (word.load() & bit) != 0; });
+    }
+
+    void add(std::string_view key) { MDB_val k{key.size(), (void*)key.data()}; add(&k); }
+    bool may_contain(std::string_view key) const { MDB_val k{key.size(), (void*)key.data()}; return may_contain(&k); }
+
+    void note_removed() { ++_removed; }
+
+    // Snapshots (txnids) the filter holds every key of: those from the
+    // state it was built from on. Older snapshots may still see keys deleted
+    // before that and must not consult it. Set before it's shared.
+    void set_since(uint64_t txnid) { _since = txnid; }
+    bool covers(uint64_t snapshot) const { return snapshot >= _since; }
+
+    size_t added() const { return _added; }
+    size_t removed() const { return _removed; }
+    size_t capacity() const { return _capacity; }
+    size_t size_bytes() const { return _blocks * block_words * sizeof(uint64_t); }
+
+    // more adds than it was sized for, false positives climb fast from here
+    bool saturated() const { return _added > _capacity; }
+
+    // writes the filter with a tag (e.g. the txnid it is current as of) to path
+    bool save(const std::string& path, uint64_t tag) const
+    {
+        std::string tmp = path + ".tmp";
+        FILE* f = std::fopen(tmp.c_str(), "wb");
+        if (f == nullptr)
+            return false;
+        Header h{{'L', 'M', 'D', 'B', 'P', 'P', 'B', 'F'}, _version, tag, _blocks, (uint64_t)_hashes, _capacity, _added, _removed};
+        bool ok = std::fwrite(&h, sizeof(h), 1, f) == 1;
+        std::vector<uint64_t> block(block_words);
+        for (size_t b = 0; ok && b < _blocks; ++b)
+        {
+            for (size_t w = 0; w < block_words; ++w)
+                block[w] = _words[b * block_words + w].load(std::memory_order_relaxed);
+            ok = std::fwrite(block.data(), sizeof(uint64_t), block_words, f) == block_words;
+        }
+        ok = std::fclose(f) == 0 && ok;
+        // renamed into place only once complete, a crash leaves the old file or none
+        if (ok)
+            ok = std::rename(tmp.c_str(), path.c_str()) == 0;
+        if (!ok)
+            std::remove(tmp.c_str());
+        return ok;
+    }
+
+    // nullptr if path doesn't hold a filter written by save()
+    static std::unique_ptr<BloomFilter> load(const std::string& path, uint64_t& tag)
+    {
+        FILE* f = std::fopen(path.c_str(), "rb");
+        if (f == nullptr)
+            return nullptr;
+        std::unique_ptr<BloomFilter> filter;
+        Header h;
+        if (std::fread(&h, sizeof(h), 1, f) == 1 && std::memcmp(h.magic, "LMDBPPBF", 8) == 0 && h.version == _version
+            && h.blocks > 0 && h.hashes > 0 && h.hashes <= 16)
+        {
+            filter.reset(new BloomFilter(h.blocks, (int)h.hashes, h.capacity));
+            std::vector<uint64_t> words(h.blocks * block_words);
+            if (std::fread(words.data(), sizeof(uint64_t), words.size(), f) == words.size())
+            {
+                for (size_t w = 0; w < words.size(); ++w)
+                    filter->_words[w].store(words[w], std::memory_order_relaxed);
+                filter->_added = h.added;
+                filter->_removed = h.removed;
+                tag = h.tag;
+            }
+            else
+            {
+                filter.reset();
+            }
+        }
+        std::fclose(f);
+        return filter;
+    }
+
+private:
+    static constexpr uint64_t _version = 1;
+
+    struct Header
+    {
+        char magic[8];
+        uint64_t version;
+        uint64_t tag;
+        uint64_t blocks;
+        uint64_t hashes;
+        uint64_t capacity;
+        uint64_t added;
+        uint64_t removed;
+    };
+
+    BloomFilter(size_t blocks, int hashes, size_t capacity)
+        : _blocks(blocks)
+        , _hashes(hashes)
+        , _capacity(capacity)
+        , _words(new std::atomic<uint64_t>[_blocks * block_words]{})
+    {
+    }
+
+    // low half of the hash picks the block, the high half the bits in it
+    // (double hashing, h2 odd so the probes don't repeat within a block)
+    template <typename F>
+    bool _probe(const MDB_val* key, F&& fn) const
+    {
+        uint64_t h = hash(key->mv_data, key->mv_size);
+        std::atomic<uint64_t>* block = &_words[(size_t)((uint32_t)h % _blocks) * block_words];
+        uint32_t h1 = (uint32_t)(h >> 32), h2 = std::rotl(h1, 13) | 1;
+        for (int i = 0; i < _hashes; ++i)
+        {
+            uint32_t bit = (h1 + i * h2) % block_bits;
+            if (!fn(block[bit / 64], 1ull << (bit % 64)))
+                return false;
+        }
+        return true;
+    }
+
+    const size_t _blocks;
+    const int _hashes;
+    const size_t _capacity;
+    uint64_t _since = 0;
+    std::unique_ptr<std::atomic<uint64_t>[]> _words;
+    std::atomic<size_t> _added{0};
+    std::atomic<size_t> _removed{0};
+};
+
+}  // namespace lmdbpp
+
+#endif
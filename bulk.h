@@ -0,0 +1,387 @@
+#ifndef __lmdbpp_bulk_h
+#define __lmdbpp_bulk_h
+
+#include <lmdb.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <future>
+#include <memory>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "lmdbpp.h"
+
+namespace lmdbpp
+{
+
+struct BulkLoadArgs
+{
+    size_t run_bytes = 64 * 1024 * 1024;        // input buffered in memory before a run is sorted and spilled
+    size_t commit_bytes = 64 * 1024 * 1024;     // bytes written per write transaction, keeps clear of TxnFullError
+    size_t threads = std::max(1u, std::thread::hardware_concurrency()); // runs sorted concurrently
+    // Later values for a key replace earlier ones (loaded or already in the
+    // dbi) instead of being skipped. For DUPSORT dbis: the loaded values
+    // replace the duplicates a key already has, rather than joining them.
+    bool overwrite = false;
+};
+
+struct BulkLoadStats
+{
+    uint64_t records = 0;
+    uint64_t runs = 0;          // sorted runs, all but the last one spilled to temp files
+    uint64_t appended = 0;      // written through MDB_APPEND/MDB_APPENDDUP
+    uint64_t multiple = 0;      // written through MDB_MULTIPLE
+    uint64_t put = 0;           // out of order for the dbi, written with a plain put
+    uint64_t skipped = 0;       // already present and not overwritten
+    uint64_t commits = 0;
+};
+
+// Loads unsorted key/value pairs into a dbi as fast as LMDB allows. Input is
+// collected into memory-bounded runs that are sorted on background threads
+// and spilled to temp files, then merged and written in key order, through
+// MDB_APPEND/MDB_APPENDDUP, or MDB_MULTIPLE for DUPFIXED dbis. Keys that are
+// not past the end of the dbi (it was not empty, or has a non-memcmp order)
+// quietly fall back to a regular put.
+class BulkLoader
+{
+public:
+    BulkLoader(Env& env, Dbi dbi, BulkLoadArgs args = BulkLoadArgs{})
+        : _env(env)
+        , _dbi(dbi)
+        , _args(args)
+    {
+        Txn txn{_env, MDB_RDONLY};
+        DbiFlags flags = txn.dbi_flags(_dbi);
+        _dupsort = (flags & DbiFlags::DUPSORT) != DbiFlags::NONE;
+        _dupfixed = (flags & DbiFlags::DUPFIXED) != DbiFlags::NONE;
+    }
+
+    // drops everything not loaded by finish()
+    ~BulkLoader()
+    {
+        for (auto& f : _sorting)
+        {
+            try { std::fclose(f.get()); }
+            catch (...) {}
+        }
+        for (std::FILE* f : _spilled)
+            std::fclose(f);
+    }
+
+    BulkLoader(const BulkLoader&) = delete;
+    BulkLoader& operator=(const BulkLoader&) = delete;
+
+    void add(std::string_view key, std::string_view val)
+    {
+        _run->recs.push_back({_run->arena.size(), (uint32_t)key.size(), (uint32_t)val.size()});
+        _run->arena.append(key);
+        _run->arena.append(val);
+        ++_stats.records;
+        if (_run->arena.size() >= _args.run_bytes)
+            _spill();
+    }
+
+    template <typename TKey, typename TVal>
+    void add(const Val<TKey>& key, const Val<TVal>& val)
+    {
+        add(std::string_view{(const char*)key.data(), key.size()}, std::string_view{(const char*)val.data(), val.size()});
+    }
+
+    // merges all runs and writes them, committing every commit_bytes
+    BulkLoadStats finish()
+    {
+        for (auto& f : _sorting)
+            _spilled.push_back(f.get());
+        _sorting.clear();
+        _sort(*_run, _dupsort);
+        if (!_run->recs.empty())
+            ++_stats.runs;
+
+        std::vector<Source> sources;
+        sources.reserve(_spilled.size() + 1);
+        for (std::FILE* f : _spilled)
+        {
+            std::rewind(f);
+            sources.emplace_back(f, nullptr);
+        }
+        sources.emplace_back(nullptr, _run.get());
+        _write(sources);
+
+        for (std::FILE* f : _spilled)
+            std::fclose(f);
+        _spilled.clear();
+        _run = std::make_unique<Run>();
+        return _stats;
+    }
+
+private:
+    struct Rec
+    {
+        size_t offset;
+        uint32_t key_size;
+        uint32_t val_size;
+    };
+
+    struct Run
+    {
+        std::string arena;
+        std::vector<Rec> recs;
+
+        std::string_view key(const Rec& r) const { return {arena.data() + r.offset, r.key_size}; }
+        std::string_view val(const Rec& r) const { return {arena.data() + r.offset + r.key_size, r.val_size}; }
+    };
+
+    // a sorted run, either spilled to a file or still in memory
+    struct Source
+    {
+        Source(std::FILE* file, const Run* run) : file(file), run(run) {}
+
+        std::FILE* file;
+        const Run* run;
+        size_t pos = 0;
+        std::string key_buf, val_buf;
+        std::string_view key, val;
+
+        bool next()
+        {
+            if (run != nullptr)
+            {
+                if (pos >= run->recs.size())
+                    return false;
+                key = run->key(run->recs[pos]);
+                val = run->val(run->recs[pos]);
+                ++pos;
+                return true;
+            }
+            uint32_t sizes[2];
+            if (std::fread(sizes, sizeof(sizes), 1, file) != 1)
+                return false;
+            key_buf.resize(sizes[0]);
+            val_buf.resize(sizes[1]);
+            if ((sizes[0] > 0 && std::fread(key_buf.data(), sizes[0], 1, file) != 1)
+                || (sizes[1] > 0 && std::fread(val_buf.data(), sizes[1], 1, file) != 1))
+                return false;
+            key = key_buf;
+            val = val_buf;
+            return true;
+        }
+
+    };
+
+    // In memcmp order like LMDB's defaults: by key, then for DUPSORT dbis by
+    // value. Otherwise equal keys stay in the order they were added, so the
+    // first one is written and later ones replace it or are skipped.
+    static void _sort(Run& run, bool dupsort)
+    {
+        if (dupsort)
+        {
+            std::sort(run.recs.begin(), run.recs.end(), [&run](const Rec& a, const Rec& b)
+            {
+                int c = run.key(a).compare(run.key(b));
+                return c != 0 ? c < 0 : run.val(a) < run.val(b);
+            });
+            return;
+        }
+        std::stable_sort(run.recs.begin(), run.recs.end(), [&run](const Rec& a, const Rec& b) { return run.key(a) < run.key(b); });
+    }
+
+    // sorts the current run on a background thread and writes it to a temp file
+    void _spill()
+    {
+        // at most `threads` runs in flight, the oldest one is likely done first
+        while (_sorting.size() >= _args.threads)
+        {
+            _spilled.push_back(_sorting.front().get());
+            _sorting.pop_front();
+        }
+        std::shared_ptr<Run> run{std::move(_run)};
+        _run = std::make_unique<Run>();
+        ++_stats.runs;
+        _sorting.push_back(std::async(std::launch::async, [run, dupsort = _dupsort]
+        {
+            _sort(*run, dupsort);
+            std::FILE* f = std::tmpfile();
+            if (f == nullptr)
+                throw std::runtime_error("BulkLoader: can not create temp file");
+            bool ok = true;
+            for (size_t i = 0; ok && i < run->recs.size(); ++i)
+            {
+                const Rec& r = run->recs[i];
+                uint32_t sizes[2] = {r.key_size, r.val_size};
+                ok = std::fwrite(sizes, sizeof(sizes), 1, f) == 1
+                    && (r.key_size + r.val_size == 0 || std::fwrite(run->arena.data() + r.offset, r.key_size + r.val_size, 1, f) == 1);
+            }
+            if (!ok || std::fflush(f) != 0)
+            {
+                std::fclose(f);
+                throw std::runtime_error("BulkLoader: writing temp file failed");
+            }
+            return f;
+        }));
+    }
+
+    void _write(std::vector<Source>& sources)
+    {
+        // sources are in the order they were added, which breaks ties between equal keys
+        bool dupsort = _dupsort, dupfixed = _dupfixed;
+        auto later = [&sources, dupsort](size_t a, size_t b)
+        {
+            int c = sources[a].key.compare(sources[b].key);
+            if (c == 0 && dupsort)
+                c = sources[a].val.compare(sources[b].val);
+            return c != 0 ? c > 0 : a > b;
+        };
+        std::priority_queue<size_t, std::vector<size_t>, decltype(later)> heap{later};
+        for (size_t i = 0; i < sources.size(); ++i)
+            if (sources[i].next())
+                heap.push(i);
+
+        std::optional<Txn> txn;
+        std::optional<Cursor> cursor;
+
+        std::string last_key, fixed_vals;
+        size_t fixed_size = 0, written = 0;
+        bool have_last = false;
+
+        auto begin = [&]
+        {
+            txn.emplace(_env);
+            cursor.emplace(*txn, _dbi);
+            written = 0;
+        };
+        auto commit = [&]
+        {
+            cursor.reset();
+            txn->commit();
+            txn.reset();
+            ++_stats.commits;
+        };
+        auto put = [&](std::string_view key, std::string_view val, unsigned int fast)
+        {
+            MDB_val k{key.size(), (void*)key.data()}, v{val.size(), (void*)val.data()};
+            int rc = mdb_cursor_put(cursor->mdb_cursor(), &k, &v, fast);
+            if (rc == 0)
+            {
+                txn->note_put(_dbi, &k, &v, 0);
+                ++_stats.appended;
+                return;
+            }
+            if (rc != MDB_KEYEXIST)
+                check(rc);
+            unsigned int slow = _args.overwrite ? 0 : (dupsort ? MDB_NODUPDATA : MDB_NOOVERWRITE);
+            rc = mdb_cursor_put(cursor->mdb_cursor(), &k, &v, slow);
+            if (rc == MDB_KEYEXIST)
+            {
+                ++_stats.skipped;
+                return;
+            }
+            check(rc);
+            txn->note_put(_dbi, &k, &v, 0);
+            ++_stats.put;
+        };
+        // MDB_MULTIPLE may store fewer items than asked for, so go until all are in
+        auto put_fixed = [&]
+        {
+            size_t count = fixed_vals.size() / fixed_size;
+            for (size_t done = 0; done < count;)
+            {
+                MDB_val k{last_key.size(), last_key.data()};
+                MDB_val v[2] = {{fixed_size, fixed_vals.data() + done * fixed_size}, {count - done, nullptr}};
+                check(mdb_cursor_put(cursor->mdb_cursor(), &k, v, MDB_MULTIPLE));
+                // v[1] now holds how many were stored
+                txn->note_put(_dbi, &k, v, MDB_MULTIPLE);
+                done += v[1].mv_size;
+                _stats.multiple += v[1].mv_size;
+            }
+            fixed_vals.clear();
+        };
+        // the duplicates a key had before the load make way for the loaded ones
+        auto replace_dups = [&](std::string_view key)
+        {
+            MDB_val k{key.size(), (void*)key.data()}, v;
+            int rc = mdb_cursor_get(cursor->mdb_cursor(), &k, &v, MDB_SET);
+            if (rc == MDB_NOTFOUND)
+                return;
+            check(rc);
+            check(mdb_cursor_del(cursor->mdb_cursor(), MDB_NODUPDATA));
+            txn->note_del(_dbi, &k, nullptr);
+        };
+
+        try
+        {
+            begin();
+            while (!heap.empty())
+            {
+                Source& s = sources[heap.top()];
+                bool same_key = have_last && s.key == last_key;
+                if (dupsort && _args.overwrite && !same_key)
+                {
+                    if (!fixed_vals.empty())
+                        put_fixed();
+                    replace_dups(s.key);
+                }
+
+                if (dupfixed)
+                {
+                    if ((!same_key || s.val.size() != fixed_size) && !fixed_vals.empty())
+                        put_fixed();
+                    fixed_size = s.val.size();
+                    fixed_vals.append(s.val);
+                }
+                else
+                {
+                    put(s.key, s.val, same_key && dupsort ? MDB_APPENDDUP : MDB_APPEND);
+                }
+                written += s.key.size() + s.val.size();
+                if (!same_key)
+                {
+                    last_key.assign(s.key);
+                    have_last = true;
+                }
+
+                size_t i = heap.top();
+                heap.pop();
+                if (sources[i].next())
+                    heap.push(i);
+
+                if (written >= _args.commit_bytes)
+                {
+                    if (!fixed_vals.empty())
+                        put_fixed();
+                    commit();
+                    begin();
+                }
+            }
+            if (!fixed_vals.empty())
+                put_fixed();
+            commit();
+        }
+        catch (...)
+        {
+            cursor.reset();
+            if (txn)
+                txn->abort();
+            throw;
+        }
+    }
+
+    Env& _env;
+    Dbi _dbi;
+    const BulkLoadArgs _args;
+    bool _dupsort = false;
+    bool _dupfixed = false;
+    std::unique_ptr<Run> _run = std::make_unique<Run>();
+    std::deque<std::future<std::FILE*>> _sorting;
+    std::vector<std::FILE*> _spilled;
+    BulkLoadStats _stats;
+};
+
+}  // namespace lmdbpp
+
+#endif
@@ -0,0 +1,226 @@
+#ifndef __lmdbpp_cache_h
+#define __lmdbpp_cache_h
+
+#include <lmdb.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "lmdbpp.h"
+#include "codec.h"
+
+namespace lmdbpp
+{
+
+struct CacheArgs
+{
+    size_t capacity = 64 * 1024;    // entries, over all shards
+    size_t shards = 16;             // independently locked parts, a power of two is not required
+};
+
+struct CacheStats
+{
+    uint64_t hits = 0;
+    uint64_t misses = 0;            // looked up in the table and decoded
+    uint64_t evictions = 0;
+};
+
+// Keeps decoded values of a Table in memory, so reading a hot key costs a
+// hash lookup instead of a B-tree walk plus Codec<V>::decode(). Bounded,
+// split into shards with an LRU and a lock each.
+//
+// Entries remember the range of snapshots (txnids) they are valid for: from
+// the snapshot they were read in up to the first write to the key after it.
+// Writes through this class mark the key before the write transaction can
+// commit, so a reader never gets a value older than its snapshot, while
+// readers on older snapshots keep hitting the entry. What the cache can't
+// vouch for (a key marked written by a transaction newer than the reader,
+// entries evicted) it leaves to the table.
+//
+// Every write to the table has to go through put(), overwrite(), del() or
+// be announced with invalidate().
+template <typename K, typename V>
+class CachedTable
+{
+public:
+    CachedTable(Env& env, Table<K, V> table, CacheArgs args = CacheArgs{})
+        : _table(table)
+        , _shard_capacity(std::max<size_t>(1, args.capacity / std::max<size_t>(1, args.shards)))
+        , _shards(std::max<size_t>(1, args.shards))
+    {
+        // Writes from before the cache existed are unknown, so are older
+        // snapshots. Taken in a write transaction, like KeyFilter does: a
+        // writer already running could otherwise commit past the floor
+        // without an invalidate(). Don't make one on a thread in a write txn.
+        Txn txn{env};
+        uint64_t last = mdb_txn_id(txn.mdb_txn()) - 1;
+        txn.abort();
+        for (Shard& s : _shards)
+            s.floor = last;
+    }
+
+    CachedTable(const CachedTable&) = delete;
+    CachedTable& operator=(const CachedTable&) = delete;
+
+    Table<K, V>& table() { return _table; }
+
+    // decoded value of key as of txn's snapshot, nullptr if there is none
+    std::shared_ptr<const V> get(ReadOnlyTxn& txn, const K& key)
+    {
+        EncodedKey<K> k{key};
+        std::string_view encoded = k.val().to_strview();
+        uint64_t snapshot = mdb_txn_id(txn.mdb_txn());
+        Shard& s = _shard(encoded);
+        {
+            std::lock_guard lock{s.mutex};
+            auto it = s.index.find(encoded);
+            if (it != s.index.end() && it->second->entry.covers(snapshot))
+            {
+                s.lru.splice(s.lru.begin(), s.lru, it->second);
+                ++_stats.hits;
+                return it->second->entry.val;
+            }
+        }
+        ++_stats.misses;
+        auto val = _read(txn, k);
+        _insert(s, encoded, snapshot, val);
+        return val;
+    }
+
+    // in a write transaction: read from the table, what it sees may never commit
+    std::shared_ptr<const V> get(Txn& txn, const K& key)
+    {
+        EncodedKey<K> k{key};
+        return _read(txn, k);
+    }
+
+    void put(Txn& txn, const K& key, const V& val) { invalidate(txn, key); _table.put(txn, key, val); }
+    void overwrite(Txn& txn, const K& key, const V& val) { invalidate(txn, key); _table.overwrite(txn, key, val); }
+    bool del(Txn& txn, const K& key) { invalidate(txn, key); return _table.del(txn, key); }
+
+    // Marks key as written by write transaction txn: entries read before it
+    // stay valid for snapshots older than txn, later ones see the table.
+    // Marking before the commit is what keeps readers from ever seeing an
+    // entry the commit made stale; an abort only costs a few misses.
+    void invalidate(Txn& txn, const K& key)
+    {
+        EncodedKey<K> k{key};
+        std::string_view encoded = k.val().to_strview();
+        uint64_t written = mdb_txn_id(txn.mdb_txn());
+        Shard& s = _shard(encoded);
+        std::lock_guard lock{s.mutex};
+        auto it = s.index.find(encoded);
+        if (it == s.index.end())
+        {
+            // remember the write, so no reader on an older snapshot caches the old value
+            _emplace(s, encoded, Entry{nullptr, 0, 0, written, false});
+            return;
+        }
+        Entry& e = it->second->entry;
+        if (e.cached && e.hi == Entry::open)
+            e.hi = written;
+        e.written = std::max(e.written, written);
+    }
+
+    CacheStats stats() const
+    {
+        return CacheStats{_stats.hits.load(), _stats.misses.load(), _stats.evictions.load()};
+    }
+
+private:
+    struct Entry
+    {
+        static constexpr uint64_t open = std::numeric_limits<uint64_t>::max();
+
+        std::shared_ptr<const V> val;   // nullptr: the key didn't exist
+        uint64_t lo;                    // valid for snapshots in [lo, hi)
+        uint64_t hi;
+        uint64_t written;               // txnid of the last write to the key known
+        bool cached;                    // false: only a marked write, no value
+
+        bool covers(uint64_t snapshot) const { return cached && lo <= snapshot && snapshot < hi; }
+    };
+
+    struct Node
+    {
+        std::string key;
+        Entry entry;
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::list<Node> lru;            // most recently used first
+        std::unordered_map<std::string_view, typename std::list<Node>::iterator> index;  // keys point into lru
+        uint64_t floor = 0;             // reads from snapshots older than this aren't cached
+    };
+
+    struct AtomicStats
+    {
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> misses{0};
+        std::atomic<uint64_t> evictions{0};
+    };
+
+    Shard& _shard(std::string_view encoded) { return _shards[std::hash<std::string_view>{}(encoded) % _shards.size()]; }
+
+    std::shared_ptr<const V> _read(Txn& txn, const EncodedKey<K>& k)
+    {
+        Val<const char> v;
+        if (!txn.try_get(_table.dbi(), k.val(), v))
+            return nullptr;
+        return std::make_shared<const V>(decode<V>(v));
+    }
+
+    // caches what a reader found at snapshot, unless a write it can't see
+    // (or one the cache forgot) might have changed the key since
+    void _insert(Shard& s, std::string_view encoded, uint64_t snapshot, std::shared_ptr<const V> val)
+    {
+        std::lock_guard lock{s.mutex};
+        if (snapshot < s.floor)
+            return;
+        auto it = s.index.find(encoded);
+        if (it == s.index.end())
+        {
+            _emplace(s, encoded, Entry{std::move(val), snapshot, Entry::open, 0, true});
+            return;
+        }
+        Entry& e = it->second->entry;
+        if (snapshot < e.written || (e.cached && snapshot < e.lo))
+            return;
+        e = Entry{std::move(val), snapshot, Entry::open, e.written, true};
+        s.lru.splice(s.lru.begin(), s.lru, it->second);
+    }
+
+    void _emplace(Shard& s, std::string_view encoded, Entry entry)
+    {
+        s.lru.push_front(Node{std::string{encoded}, std::move(entry)});
+        s.index.emplace(s.lru.front().key, s.lru.begin());
+        while (s.lru.size() > _shard_capacity)
+        {
+            // what the evicted entry knew about writes is lost, older snapshots may not fill it in again
+            Node& victim = s.lru.back();
+            s.floor = std::max(s.floor, victim.entry.written);
+            s.index.erase(victim.key);
+            s.lru.pop_back();
+            ++_stats.evictions;
+        }
+    }
+
+    Table<K, V> _table;
+    const size_t _shard_capacity;
+    std::vector<Shard> _shards;
+    AtomicStats _stats;
+};
+
+}  // namespace lmdbpp
+
+#endif
@@ -0,0 +1,217 @@
+#ifndef __lmdbpp_changelog_h
+#define __lmdbpp_changelog_h
+
+#include <lmdb.h>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lmdbpp
+{
+
+enum class ChangeOp : uint8_t
+{
+    PUT = 1,
+    DEL = 2,        // the key with all its values
+    DEL_DUP = 3     // one key/value pair
+};
+
+// one record of a change log, views into the log's value
+struct Change
+{
+    uint64_t seq;
+    uint64_t txnid;         // of the write transaction that made it
+    ChangeOp op;
+    unsigned int flags;     // of the dbi, what it has to be created with elsewhere
+    std::string_view dbi;   // name, empty for the main dbi
+    std::string_view key;
+    std::string_view val;   // empty for DEL
+};
+
+// A reader's position is behind the part of the change log trimmed away,
+// the changes it hasn't seen yet are gone
+class ChangeLogTrimmedError : public std::runtime_error
+{
+public:
+    ChangeLogTrimmedError(uint64_t position, uint64_t trimmed)
+        : runtime_error{"lmdbpp: change log trimmed past the reader's position"}
+        , position(position)
+        , trimmed(trimmed)
+    {
+    }
+
+    uint64_t position;
+    uint64_t trimmed;   // records up to this sequence number were deleted
+};
+
+// Records every write to the tracked dbis into a log dbi, in the write's
+// own transaction, so the log commits or aborts together with it. Keys are
+// big endian sequence numbers, increasing in commit order (with gaps where
+// transactions aborted). Values hold txnid, op, the dbi's name and flags,
+// key and value, lengths in native byte order (logs are read on the same
+// machine). Sequence number 0 holds how far the log has been trimmed.
+//
+// Attach it with Env::set_change_log(); Txn, Cursor and the other write
+// paths feed it through Txn::note_put()/note_del(). Set up what's tracked
+// before writes start.
+class ChangeLog
+{
+public:
+    ChangeLog(MDB_dbi log) : _log(log) {}
+
+    ChangeLog(const ChangeLog&) = delete;
+    ChangeLog& operator=(const ChangeLog&) = delete;
+
+    // records writes to dbi, as the dbi called name (nullptr for the main dbi)
+    void track(MDB_dbi dbi, const char* name = nullptr)
+    {
+        if (dbi >= _names.size())
+            _names.resize(dbi + 1);
+        _names[dbi] = name ? name : "";
+    }
+
+    bool tracks(MDB_dbi dbi) const { return dbi < _names.size() && _names[dbi].has_value(); }
+    MDB_dbi dbi() const { return _log; }
+
+    // appends a record of a write made in txn, returns an LMDB error code
+    int append(MDB_txn* txn, ChangeOp op, MDB_dbi dbi, const MDB_val* key, const MDB_val* val)
+    {
+        unsigned int flags = 0;
+        int rc = mdb_dbi_flags(txn, dbi, &flags);
+        if (rc != 0)
+            return rc;
+        uint64_t seq;
+        if ((rc = _next(txn, seq)) != 0)
+            return rc;
+
+        const std::string& name = *_names[dbi];
+        uint64_t txnid = mdb_txn_id(txn);
+        uint32_t name_size = name.size(), key_size = key->mv_size;
+        size_t val_size = val ? val->mv_size : 0;
+        char seq_key[8];
+        encode_seq(seq, seq_key);
+        MDB_val k{sizeof(seq_key), seq_key};
+        MDB_val v{header_size + name_size + key_size + val_size, nullptr};
+        // appended in place, sequence numbers only grow
+        if ((rc = mdb_put(txn, _log, &k, &v, MDB_APPEND | MDB_RESERVE)) != 0)
+            return rc;
+        char* out = (char*)v.mv_data;
+        auto write = [&](const void* data, size_t size) { std::memcpy(out, data, size); out += size; };
+        write(&txnid, sizeof(txnid));
+        write(&op, sizeof(op));
+        write(&flags, sizeof(flags));
+        write(&name_size, sizeof(name_size));
+        write(&key_size, sizeof(key_size));
+        write(name.data(), name_size);
+        write(key->mv_data, key_size);
+        if (val_size > 0)
+            write(val->mv_data, val_size);
+        _last = {txnid, seq};
+        return 0;
+    }
+
+    static void encode_seq(uint64_t seq, char* out)
+    {
+        for (int i = 7; i >= 0; --i, seq >>= 8)
+            out[i] = (char)(seq & 0xff);
+    }
+
+    static uint64_t decode_seq(const char* in)
+    {
+        uint64_t seq = 0;
+        for (int i = 0; i < 8; ++i)
+            seq = (seq << 8) | (unsigned char)in[i];
+        return seq;
+    }
+
+    // sequence number up to which log's records have been trimmed, 0 if none were
+    static int trimmed(MDB_txn* txn, MDB_dbi log, uint64_t& upto)
+    {
+        char key[8];
+        encode_seq(0, key);
+        MDB_val k{sizeof(key), key}, v;
+        upto = 0;
+        int rc = mdb_get(txn, log, &k, &v);
+        if (rc == MDB_NOTFOUND)
+            return 0;
+        if (rc == 0 && v.mv_size == 8)
+            upto = decode_seq((const char*)v.mv_data);
+        return rc;
+    }
+
+    // nullopt if key/val isn't a record of a change log
+    static std::optional<Change> decode(std::string_view key, std::string_view val)
+    {
+        if (key.size() != 8 || val.size() < header_size)
+            return std::nullopt;
+        Change c;
+        uint32_t name_size, key_size;
+        const char* in = val.data();
+        auto read = [&](void* data, size_t size) { std::memcpy(data, in, size); in += size; };
+        c.seq = decode_seq(key.data());
+        read(&c.txnid, sizeof(c.txnid));
+        read(&c.op, sizeof(c.op));
+        read(&c.flags, sizeof(c.flags));
+        read(&name_size, sizeof(name_size));
+        read(&key_size, sizeof(key_size));
+        if ((size_t)name_size + key_size > val.size() - header_size)
+            return std::nullopt;
+        c.dbi = {in, name_size};
+        c.key = {in + name_size, key_size};
+        c.val = {in + name_size + key_size, val.size() - header_size - name_size - key_size};
+        return c;
+    }
+
+private:
+    static constexpr size_t header_size = sizeof(uint64_t) + sizeof(ChangeOp) + sizeof(unsigned int) + 2 * sizeof(uint32_t);
+
+    struct Last
+    {
+        uint64_t txnid = 0;
+        uint64_t seq = 0;
+    };
+
+    // Write transactions run one at a time, so the last sequence number
+    // handed out is remembered per txnid and only looked up (MDB_LAST) on the
+    // first append of a transaction. An aborted one leaves a gap.
+    int _next(MDB_txn* txn, uint64_t& seq)
+    {
+        if (_last.txnid != 0 && _last.txnid == mdb_txn_id(txn))
+        {
+            seq = _last.seq + 1;
+            return 0;
+        }
+        MDB_cursor* c;
+        int rc = mdb_cursor_open(txn, _log, &c);
+        if (rc != 0)
+            return rc;
+        MDB_val k, v;
+        rc = mdb_cursor_get(c, &k, &v, MDB_LAST);
+        mdb_cursor_close(c);
+        if (rc == MDB_NOTFOUND)
+        {
+            seq = 1;
+            return 0;
+        }
+        if (rc != 0)
+            return rc;
+        seq = k.mv_size == 8 ? decode_seq((const char*)k.mv_data) : 0;
+        // everything was trimmed, carry on after the last sequence number deleted
+        if (seq == 0 && v.mv_size == 8)
+            seq = decode_seq((const char*)v.mv_data);
+        ++seq;
+        return 0;
+    }
+
+    const MDB_dbi _log;
+    std::vector<std::optional<std::string>> _names;
+    Last _last;
+};
+
+}  // namespace lmdbpp
+
+#endif
@@ -0,0 +1,373 @@
+#ifndef __lmdbpp_codec_h
+#define __lmdbpp_codec_h
+
+#include <lmdb.h>
+#include <array>
+#include <bit>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include "lmdbpp.h"
+#include "iterators.h"
+
+namespace lmdbpp
+{
+
+// default MDB_MAXKEYSIZE, keys are encoded into stack buffers of this size
+constexpr size_t max_key_size = 511;
+
+// Codec<T> turns T into bytes whose memcmp order is T's natural order, so the
+// default comparator sorts encoded keys correctly:
+//
+//   static constexpr size_t max_size;                    // upper bound, SIZE_MAX if unbounded
+//   static size_t size(const T& v, bool last);           // bytes encode() will write
+//   static char* encode(const T& v, char* out, bool last); // returns the end of the output
+//   static T decode(std::string_view& in, bool last);    // consumes its bytes from the front of in
+//
+// `last` says whether the value ends the buffer, variable sized values inside
+// a tuple need to be self delimiting.
+template <typename T>
+struct Codec;
+
+namespace detail
+{
+template <typename U>
+char* store_be(U v, char* out)
+{
+    for (int i = sizeof(U) - 1; i >= 0; --i, v >>= 8)
+        out[i] = (char)(unsigned char)v;
+    return out + sizeof(U);
+}
+
+template <typename U>
+U load_be(std::string_view& in)
+{
+    if (in.size() < sizeof(U))
+        throw BadValsizeError(MDB_BAD_VALSIZE);
+    U v = 0;
+    for (size_t i = 0; i < sizeof(U); ++i)
+        v = (U)((v << 8) | (unsigned char)in[i]);
+    in.remove_prefix(sizeof(U));
+    return v;
+}
+}  // namespace detail
+
+// big-endian, with the sign bit flipped for signed types
+template <typename T> requires std::integral<T> && (!std::same_as<T, bool>)
+struct Codec<T>
+{
+    typedef std::make_unsigned_t<T> U;
+    static constexpr U flip = std::is_signed_v<T> ? (U)((U)1 << (sizeof(T) * 8 - 1)) : 0;
+    static constexpr size_t max_size = sizeof(T);
+
+    static size_t size(T, bool) { return sizeof(T); }
+    static char* encode(T v, char* out, bool) { return detail::store_be<U>((U)v ^ flip, out); }
+    static T decode(std::string_view& in, bool) { return (T)(detail::load_be<U>(in) ^ flip); }
+};
+
+// one byte, false before true
+template <>
+struct Codec<bool>
+{
+    static constexpr size_t max_size = 1;
+
+    static size_t size(bool, bool) { return 1; }
+    static char* encode(bool v, char* out, bool) { *out = v ? 1 : 0; return out + 1; }
+    static bool decode(std::string_view& in, bool)
+    {
+        if (in.empty())
+            throw BadValsizeError(MDB_BAD_VALSIZE);
+        bool v = in[0] != 0;
+        in.remove_prefix(1);
+        return v;
+    }
+};
+
+// IEEE 754 bits, sign bit flipped for positives and all bits flipped for negatives
+template <std::floating_point T>
+struct Codec<T>
+{
+    typedef std::conditional_t<sizeof(T) == 8, uint64_t, uint32_t> U;
+    static constexpr U sign = (U)1 << (sizeof(T) * 8 - 1);
+    static constexpr size_t max_size = sizeof(T);
+
+    static size_t size(T, bool) { return sizeof(T); }
+    static char* encode(T v, char* out, bool)
+    {
+        U bits = std::bit_cast<U>(v);
+        return detail::store_be<U>((bits & sign) ? ~bits : bits | sign, out);
+    }
+    static T decode(std::string_view& in, bool)
+    {
+        U bits = detail::load_be<U>(in);
+        return std::bit_cast<T>((bits & sign) ? bits & ~sign : ~bits);
+    }
+};
+
+// raw bytes, decoded without copying; only valid as the last part of a key
+template <>
+struct Codec<std::string_view>
+{
+    static constexpr size_t max_size = SIZE_MAX;
+
+    static size_t size(std::string_view v, bool) { return v.size(); }
+    static char* encode(std::string_view v, char* out, bool last)
+    {
+        if (!last)
+            throw InvalidError(MDB_INVALID);    // use std::string inside tuples
+        std::memcpy(out, v.data(), v.size());
+        return out + v.size();
+    }
+    static std::string_view decode(std::string_view& in, bool)
+    {
+        std::string_view v = in;
+        in = {};
+        return v;
+    }
+};
+
+// raw bytes when last, otherwise 0x00 is escaped as 0x00 0xff and the string
+// ends with 0x00 0x01, which keeps tuple ordering intact
+template <>
+struct Codec<std::string>
+{
+    static constexpr size_t max_size = SIZE_MAX;
+
+    static size_t size(const std::string& v, bool last)
+    {
+        if (last)
+            return v.size();
+        size_t zeros = 0;
+        for (char c : v)
+            zeros += c == 0;
+        return v.size() + zeros + 2;
+    }
+    static char* encode(const std::string& v, char* out, bool last)
+    {
+        if (last)
+        {
+            std::memcpy(out, v.data(), v.size());
+            return out + v.size();
+        }
+        for (char c : v)
+        {
+            *out++ = c;
+            if (c == 0)
+                *out++ = (char)0xff;
+        }
+        *out++ = 0;
+        *out++ = 1;
+        return out;
+    }
+    static std::string decode(std::string_view& in, bool last)
+    {
+        if (last)
+        {
+            std::string v{in};
+            in = {};
+            return v;
+        }
+        std::string v;
+        for (size_t i = 0; i + 1 < in.size(); ++i)
+        {
+            if (in[i] != 0)
+            {
+                v.push_back(in[i]);
+                continue;
+            }
+            if (in[i + 1] == 1)
+            {
+                in.remove_prefix(i + 2);
+                return v;
+            }
+            v.push_back(0);
+            ++i;
+        }
+        throw BadValsizeError(MDB_BAD_VALSIZE);
+    }
+};
+
+// composite keys, ordered by the first element, then the second, ...
+template <typename... Ts>
+struct Codec<std::tuple<Ts...>>
+{
+    typedef std::tuple<Ts...> T;
+    static constexpr size_t N = sizeof...(Ts);
+    static constexpr size_t max_size = []
+    {
+        size_t s = 0;
+        for (size_t m : {Codec<Ts>::max_size...})
+            s = (m == SIZE_MAX || s == SIZE_MAX) ? SIZE_MAX : s + m;
+        return s;
+    }();
+
+    static size_t size(const T& v, bool last)
+    {
+        return [&]<size_t... I>(std::index_sequence<I...>)
+        {
+            return (Codec<Ts>::size(std::get<I>(v), last && I == N - 1) + ... + 0);
+        }(std::index_sequence_for<Ts...>{});
+    }
+    static char* encode(const T& v, char* out, bool last)
+    {
+        [&]<size_t... I>(std::index_sequence<I...>)
+        {
+            ((out = Codec<Ts>::encode(std::get<I>(v), out, last && I == N - 1)), ...);
+        }(std::index_sequence_for<Ts...>{});
+        return out;
+    }
+    static T decode(std::string_view& in, bool last)
+    {
+        return [&]<size_t... I>(std::index_sequence<I...>)
+        {
+            // braced init to decode in order
+            return T{Codec<Ts>::decode(in, last && I == N - 1)...};
+        }(std::index_sequence_for<Ts...>{});
+    }
+};
+
+// encodes a key into a stack buffer
+template <typename K>
+class EncodedKey
+{
+public:
+    EncodedKey(const K& key)
+    {
+        size_t size = Codec<K>::size(key, true);
+        if (size > max_key_size)
+            throw BadValsizeError(MDB_BAD_VALSIZE);
+        Codec<K>::encode(key, _buf.data(), true);
+        _val.set(_buf.data(), size);
+    }
+
+    const Val<const char>& val() const { return _val; }
+
+private:
+    std::array<char, max_key_size> _buf;
+    Val<const char> _val;
+};
+
+template <typename T>
+T decode(const Val<const char>& v)
+{
+    std::string_view in{v.data(), v.size()};
+    return Codec<T>::decode(in, true);
+}
+
+// Typed view of a dbi. Keys are encoded on the stack, values straight into the
+// map with MDB_RESERVE (on the stack for DUPSORT dbis, which can't reserve),
+// so reads and writes don't touch the heap unless K or V do themselves.
+template <typename K, typename V>
+class Table
+{
+public:
+    Table(Dbi dbi, bool dupsort = false) : _dbi(dbi), _dupsort(dupsort) {}
+
+    static Table open(Txn& txn, const char* name = nullptr, DbiFlags flags = DbiFlags::NONE)
+    {
+        return Table{txn.open_dbi(name, flags), (flags & DbiFlags::DUPSORT) != DbiFlags::NONE};
+    }
+
+    Dbi dbi() const { return _dbi; }
+    bool dupsort() const { return _dupsort; }
+
+    void put(Txn& txn, const K& key, const V& val) { _put(txn, key, val, MDB_NOOVERWRITE); }
+    void overwrite(Txn& txn, const K& key, const V& val) { _put(txn, key, val, 0); }
+
+    std::optional<V> get(Txn& txn, const K& key)
+    {
+        EncodedKey<K> k{key};
+        Val<const char> v;
+        if (!txn.try_get(_dbi, k.val(), v))
+            return std::nullopt;
+        return decode<V>(v);
+    }
+
+    bool del(Txn& txn, const K& key)
+    {
+        EncodedKey<K> k{key};
+        if (!check_found(mdb_del(txn.mdb_txn(), _dbi, k.val().mdb_val(), nullptr)))
+            return false;
+        txn.note_del(_dbi, k.val().mdb_val(), nullptr);
+        return true;
+    }
+
+    // keys in [lo, hi), decoded as std::pair<K, V>
+    class Range
+    {
+    public:
+        class iterator
+        {
+        public:
+            typedef std::pair<K, V> value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef std::input_iterator_tag iterator_concept;
+
+            iterator() = default;
+            iterator(typename iterators::KeyRange<char, char>::iterator it) : _it(it) {}
+
+            value_type operator*() const { return {decode<K>(_it->key), decode<V>(_it->val)}; }
+            iterator& operator++() { ++_it; return *this; }
+            void operator++(int) { ++_it; }
+            friend bool operator==(const iterator& it, std::default_sentinel_t s) { return it._it == s; }
+
+        private:
+            typename iterators::KeyRange<char, char>::iterator _it;
+        };
+
+        Range(Txn& txn, Dbi dbi, const std::optional<K>& lo, const std::optional<K>& hi, iterators::Order order)
+            : _range{txn, dbi, _bound(lo, _lo_buf), _bound(hi, _hi_buf), order}
+        {
+        }
+        Range(const Range&) = delete;
+
+        iterator begin() { return iterator{_range.begin()}; }
+        std::default_sentinel_t end() { return {}; }
+
+    private:
+        static iterators::KeyRange<char, char>::Bound _bound(const std::optional<K>& key, std::optional<EncodedKey<K>>& buf)
+        {
+            if (!key)
+                return std::nullopt;
+            return buf.emplace(*key).val();
+        }
+
+        std::optional<EncodedKey<K>> _lo_buf, _hi_buf;
+        iterators::KeyRange<char, char> _range;
+    };
+
+    Range range(Txn& txn, const std::optional<K>& lo, const std::optional<K>& hi, iterators::Order order = iterators::Order::FORWARD)
+    {
+        return Range{txn, _dbi, lo, hi, order};
+    }
+
+private:
+    void _put(Txn& txn, const K& key, const V& val, unsigned int flags)
+    {
+        EncodedKey<K> k{key};
+        size_t size = Codec<V>::size(val, true);
+        if (_dupsort)
+        {
+            EncodedKey<V> v{val};
+            check(mdb_put(txn.mdb_txn(), _dbi, k.val().mdb_val(), v.val().mdb_val(), flags));
+            txn.note_put(_dbi, k.val().mdb_val(), v.val().mdb_val(), flags);
+            return;
+        }
+        MDB_val v{size, nullptr};
+        check(mdb_put(txn.mdb_txn(), _dbi, k.val().mdb_val(), &v, flags | MDB_RESERVE));
+        txn.note_put(_dbi, k.val().mdb_val(), &v, flags | MDB_RESERVE);
+        Codec<V>::encode(val, (char*)v.mv_data, true);
+    }
+
+    Dbi _dbi;
+    bool _dupsort;
+};
+
+}  // namespace lmdbpp
+
+#endif
@@ -2,6 +2,9 @@
 #define __lmdbpp_cursor_h
 
 #include <lmdb.h>
+#include <optional>
+#include <span>
+#include <utility>
 #include "env.h"
 #include "error.h"
 #include "txn.h"
@@ -14,30 +17,51 @@ class Cursor
 {
 public:
     Cursor(Txn& txn, Dbi dbi)
-        : _txn(txn)
+        : _txn(&txn)
         , _dbi(dbi)
     {
-        check(mdb_cursor_open(_txn.mdb_txn(), _dbi, &_cursor));
+        check(mdb_cursor_open(_txn->mdb_txn(), _dbi, &_cursor));
     }
 
-    ~Cursor()
+    // takes a cursor from txn's cursor cache instead of opening a new one,
+    // it goes back into the cache when destroyed
+    static Cursor borrow(Txn& txn, Dbi dbi)
     {
-        if (_cursor != nullptr)
-        {
-            close();
-        }
+        return Cursor{txn, dbi, txn.acquire_cursor(dbi)};
     }
 
-    Cursor(Cursor&& o) : _txn(o._txn), _dbi(o._dbi), _cursor(o._cursor)
+    ~Cursor() { _release(); }
+
+    // the moved-from cursor is left closed
+    Cursor(Cursor&& o) : _txn(o._txn), _dbi(o._dbi), _cursor(o._cursor), _borrowed(o._borrowed)
     {
         o._cursor = nullptr;
     }
 
+    Cursor& operator=(Cursor&& o)
+    {
+        if (this != &o)
+        {
+            _release();
+            _txn = o._txn;
+            _dbi = o._dbi;
+            _cursor = std::exchange(o._cursor, nullptr);
+            _borrowed = o._borrowed;
+        }
+        return *this;
+    }
+
     Cursor(const Cursor&) = delete;
     Cursor& operator=(const Cursor&) = delete;
-    Cursor& operator=(Cursor&&) = delete;
 
-    void close() { mdb_cursor_close(_cursor); }
+    void close() { mdb_cursor_close(_cursor); _cursor = nullptr; }
+
+    // rebinds a read-only cursor to another (or a renewed) read-only transaction
+    void renew(Txn& txn)
+    {
+        check(mdb_cursor_renew(txn.mdb_txn(), _cursor));
+        _txn = &txn;
+    }
 
     MDB_cursor* mdb_cursor() { return _cursor; }
 
@@ -48,19 +72,33 @@ public:
 #define FUNC(NAME, OP) \
     TPL_KV void NAME(Val<const TKey>& key, Val<const TVal>& val) { _get(key.mdb_val(), val.mdb_val(), OP); } \
     TPL_KV void NAME(KeyVal<const TKey, const TVal>& kv) { NAME(kv.key, kv.val); } \
-    TPL_KV auto NAME() { KeyVal<const TKey, const TVal> kv; NAME(kv); return kv; }
+    TPL_KV auto NAME() { KeyVal<const TKey, const TVal> kv; NAME(kv); return kv; } \
+    TPL_KV bool try_##NAME(Val<const TKey>& key, Val<const TVal>& val) { return _try_get(key.mdb_val(), val.mdb_val(), OP); } \
+    TPL_KV bool try_##NAME(KeyVal<const TKey, const TVal>& kv) { return try_##NAME(kv.key, kv.val); } \
+    TPL_KV auto try_##NAME() { std::optional<KeyVal<const TKey, const TVal>> kv{std::in_place}; if (!try_##NAME(*kv)) kv.reset(); return kv; }
 
     FUNC(current, MDB_GET_CURRENT)
     FUNC(first, MDB_FIRST)
     FUNC(next, MDB_NEXT)
     FUNC(prev, MDB_PREV)
     FUNC(last, MDB_LAST)
+    FUNC(next_nodup, MDB_NEXT_NODUP)
+    FUNC(prev_nodup, MDB_PREV_NODUP)
 #undef FUNC
 
+    // MDB_SET_RANGE: positions at the first key >= key, key is updated to the key found
+    TPL_KV void seek_range(Val<const TKey>& key, Val<const TVal>& val) { _get(key.mdb_val(), val.mdb_val(), MDB_SET_RANGE); }
+    TPL_KV void seek_range(KeyVal<const TKey, const TVal>& kv) { seek_range(kv.key, kv.val); }
+    TPL_KV bool try_seek_range(Val<const TKey>& key, Val<const TVal>& val) { return _try_get(key.mdb_val(), val.mdb_val(), MDB_SET_RANGE); }
+    TPL_KV bool try_seek_range(KeyVal<const TKey, const TVal>& kv) { return try_seek_range(kv.key, kv.val); }
+
 #define FUNC(NAME, OP) \
-    TPL_KV void NAME(const Val<TKey>& key, Val<const TVal>& val) { _get(key.mdb_val(), val.mdb_val(), OP); } 
+    TPL_KV void NAME(const Val<TKey>& key, Val<const TVal>& val) { _get(key.mdb_val(), val.mdb_val(), OP); } \
     TPL_KV void NAME(KeyVal<TKey, const TVal>& kv) { NAME(kv.key, kv.val); } \
-    TPL_VK auto NAME(const Val<TKey>& key) { Val<const TVal> v; NAME(key, v); return v; }
+    TPL_VK auto NAME(const Val<TKey>& key) { Val<const TVal> v; NAME(key, v); return v; } \
+    TPL_KV bool try_##NAME(const Val<TKey>& key, Val<const TVal>& val) { return _try_get(key.mdb_val(), val.mdb_val(), OP); } \
+    TPL_KV bool try_##NAME(KeyVal<TKey, const TVal>& kv) { return try_##NAME(kv.key, kv.val); } \
+    TPL_VK auto try_##NAME(const Val<TKey>& key) { std::optional<Val<const TVal>> v{std::in_place}; if (!try_##NAME(key, *v)) v.reset(); return v; }
 
     FUNC(get_multiple,  MDB_GET_MULTIPLE)
     FUNC(next_multiple, MDB_NEXT_MULTIPLE)
@@ -85,25 +123,75 @@ public:
 
     TPL_KV void put(const Val<TKey>& key, const MultiVal<TVal>& val) { _put(key.mdb_val(), val.mdb_val(), MDB_MULTIPLE); }
 
+    // MDB_RESERVE, see Txn::reserve
+#define FUNC(NAME, FLAGS) \
+    TPL_K std::span<char> NAME(const Val<TKey>& key, size_t size) { MDB_val v{size, nullptr}; _put(key.mdb_val(), &v, MDB_RESERVE | FLAGS); return {(char*)v.mv_data, v.mv_size}; } \
+    template <typename TKey, typename TWriter> void NAME(const Val<TKey>& key, size_t size, TWriter&& writer) { writer(NAME(key, size)); }
+
+    FUNC(reserve, MDB_NOOVERWRITE)
+    FUNC(reserve_overwrite, 0)
+    FUNC(reserve_replace, MDB_CURRENT)
+    FUNC(reserve_append, MDB_APPEND)
+#undef FUNC
+
     TPL_K void seek(const Val<TKey>& key) { _get(key.mdb_val(), nullptr, MDB_SET); }
     TPL_KV void seek(const Val<TKey>& key, const Val<const TVal>& val) { _get(key.mdb_val(), val.mdb_val(), MDB_GET_BOTH); }
+    TPL_K bool try_seek(const Val<TKey>& key) { return _try_get(key.mdb_val(), nullptr, MDB_SET); }
+    TPL_KV bool try_seek(const Val<TKey>& key, const Val<const TVal>& val) { return _try_get(key.mdb_val(), val.mdb_val(), MDB_GET_BOTH); }
 
 
 #undef TPL_K
 #undef TPL_KV
 #undef TPL_VK
 
-    void del(bool no_dupdata = false) { check(mdb_cursor_del(_cursor, no_dupdata ? MDB_NODUPDATA : 0)); }
+    void del(bool no_dupdata = false)
+    {
+        metrics::Timer t{metrics::Op::CURSOR_DEL};
+        // the change log needs what is deleted, copied before it's gone
+        std::string key, val;
+        ChangeLog* log = _txn->env().change_log();
+        if (log != nullptr && log->tracks(_dbi))
+        {
+            MDB_val k, v;
+            check(mdb_cursor_get(_cursor, &k, &v, MDB_GET_CURRENT));
+            key.assign((const char*)k.mv_data, k.mv_size);
+            val.assign((const char*)v.mv_data, v.mv_size);
+        }
+        check(mdb_cursor_del(_cursor, no_dupdata ? MDB_NODUPDATA : 0));
+        MDB_val k{key.size(), key.data()}, v{val.size(), val.data()};
+        _txn->note_del(_dbi, &k, no_dupdata ? nullptr : &v);
+    }
 
     size_t dup_count() { size_t c; check(mdb_cursor_count(_cursor, &c)); return c; }
 
 private:
-    void _get(MDB_val* key, MDB_val* val, MDB_cursor_op op) { check(mdb_cursor_get(_cursor, key, val, op)); }
-    void _put(MDB_val* key, MDB_val* val, unsigned int flags) { check(mdb_cursor_put(_cursor, key, val, flags)); }
+    void _release()
+    {
+        if (_cursor != nullptr)
+        {
+            if (_borrowed)
+                _txn->release_cursor(_dbi, _cursor);
+            else
+                close();
+        }
+    }
+
+    void _get(MDB_val* key, MDB_val* val, MDB_cursor_op op) { metrics::Timer t{metrics::Op::CURSOR_GET}; check(mdb_cursor_get(_cursor, key, val, op)); }
+    bool _try_get(MDB_val* key, MDB_val* val, MDB_cursor_op op) { metrics::Timer t{metrics::Op::CURSOR_GET}; return check_found(mdb_cursor_get(_cursor, key, val, op)); }
+    void _put(MDB_val* key, MDB_val* val, unsigned int flags) { metrics::Timer t{metrics::Op::CURSOR_PUT}; check(mdb_cursor_put(_cursor, key, val, flags)); _txn->note_put(_dbi, key, val, flags); }
+
+    Cursor(Txn& txn, Dbi dbi, MDB_cursor* cursor)
+        : _txn(&txn)
+        , _dbi(dbi)
+        , _cursor(cursor)
+        , _borrowed(true)
+    {
+    }
 
-    Txn& _txn;
+    Txn* _txn;
     Dbi _dbi;
     MDB_cursor* _cursor = nullptr;
+    bool _borrowed = false;
 };
 
 }  // namespace lmdbpp
@@ -2,7 +2,21 @@
 #define __lmdbpp_env_h
 
 #include <lmdb.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "bloom.h"
+#include "changelog.h"
 #include "error.h"
+#include "metrics.h"
 
 namespace lmdbpp
 {
@@ -28,15 +42,131 @@ struct EnvArgs
     Flags flags = Flags::NONE;
     size_t mapsize = 0;
     unsigned int maxdbs = 1;
+    unsigned int maxreaders = 0;    // reader slots, 0 for LMDB's default (126)
     mdb_mode_t mode = 0644;
+
+    // automatic map growth on MapFullError, see Env::grow()
+    struct Growth
+    {
+        size_t max = 0;         // ceiling for the map size, 0 disables growth
+        size_t step = 0;        // grow by a fixed number of bytes ...
+        double factor = 2.0;    // ... or, if step is 0, geometrically
+        std::chrono::milliseconds wait{1000};  // for this process' transactions to end before a resize gives up
+    };
+    Growth growth{};
 };
 constexpr EnvArgs::Flags operator|(EnvArgs::Flags a, EnvArgs::Flags b) { return (EnvArgs::Flags)((int)a|(int)b); }
 constexpr EnvArgs::Flags operator&(EnvArgs::Flags a, EnvArgs::Flags b) { return (EnvArgs::Flags)((int)a&(int)b); }
 
+// Keeps a resize from moving the map under this process' transactions. Open
+// transactions are counted, not locked: a Txn may end on another thread than
+// the one that began it (MDB_NOTLS), and one thread may hold several. close()
+// turns new ones away and waits for the count to reach 0.
+class ResizeGate
+{
+public:
+    // held by a Txn for as long as it's open, movable between threads
+    class Pass
+    {
+    public:
+        Pass() = default;
+        explicit Pass(ResizeGate* gate) : _gate(gate) { if (_gate) _gate->_enter(); }
+        ~Pass() { release(); }
+
+        Pass(Pass&& o) : _gate(std::exchange(o._gate, nullptr)) {}
+        Pass& operator=(Pass&& o)
+        {
+            if (this != &o)
+            {
+                release();
+                _gate = std::exchange(o._gate, nullptr);
+            }
+            return *this;
+        }
+
+        void release()
+        {
+            if (_gate)
+                std::exchange(_gate, nullptr)->_leave();
+        }
+
+    private:
+        ResizeGate* _gate = nullptr;
+    };
+
+    // Waits up to `wait` for an other resize, then for every Pass to be
+    // released. On false the gate is open again, on true it stays closed
+    // until open().
+    bool close(std::chrono::milliseconds wait)
+    {
+        auto deadline = std::chrono::steady_clock::now() + wait;
+        std::unique_lock lock{_mutex};
+        if (!_cv.wait_until(lock, deadline, [this] { return !_closed.load(); }))
+            return false;
+        _closed = true;
+        if (_cv.wait_until(lock, deadline, [this] { return _open.load() == 0; }))
+            return true;
+        _closed = false;
+        lock.unlock();
+        _cv.notify_all();
+        return false;
+    }
+
+    void open()
+    {
+        {
+            std::lock_guard lock{_mutex};
+            _closed = false;
+        }
+        _cv.notify_all();
+    }
+
+private:
+    // seq_cst on both sides: either _enter() sees _closed, or close() sees the count
+    void _enter()
+    {
+        for (;;)
+        {
+            _open.fetch_add(1);
+            if (!_closed.load())
+                return;
+            // back out, close() may be waiting for exactly this one
+            _leave();
+            std::unique_lock lock{_mutex};
+            _cv.wait(lock, [this] { return !_closed.load(); });
+        }
+    }
+
+    void _leave()
+    {
+        if (_open.fetch_sub(1) == 1 && _closed.load())
+        {
+            std::lock_guard lock{_mutex};
+            _cv.notify_all();
+        }
+    }
+
+    std::atomic<size_t> _open{0};
+    std::atomic<bool> _closed{false};
+    std::mutex _mutex;
+    std::condition_variable _cv;
+};
+
+// one slot of the reader lock table, as listed by mdb_reader_list
+struct ReaderInfo
+{
+    int pid;
+    size_t thread;
+    size_t txnid;       // snapshot the reader holds, 0 while its transaction is reset
+};
+
 class Env
 {
 public:
     Env(const std::string& path, EnvArgs args = EnvArgs{})
+        : _growth(args.growth)
+        , _filter_slots(args.maxdbs + 2)
+        , _filters(new std::atomic<BloomFilter*>[_filter_slots]{})
     {
         mdb_env_create(&_env);
         if (args.mapsize > 0)
@@ -47,6 +177,10 @@ public:
         {
             set_maxdbs(args.maxdbs);
         }
+        if (args.maxreaders > 0)
+        {
+            set_maxreaders(args.maxreaders);
+        }
         check(mdb_env_open(_env, path.c_str(), (unsigned int)args.flags, args.mode));
     }
 
@@ -55,12 +189,111 @@ public:
     void set_maxdbs(MDB_dbi n) { check(mdb_env_set_maxdbs(_env, n)); }
     void set_mapsize(size_t size) { check(mdb_env_set_mapsize(_env, size)); }
     void set_flags(unsigned int flags, int onoff) { check(mdb_env_set_flags(_env, flags, onoff)); }
+    EnvArgs::Flags flags() const { unsigned int f = 0; check(mdb_env_get_flags(_env, &f)); return (EnvArgs::Flags)f; }
 
     MDB_env* mdb_env() const { return (MDB_env*)_env; }
 
+    size_t mapsize() const { return info().me_mapsize; }
+
+    // unthrottled copies, see backup.h for throttled ones with progress
+    void copy(const std::string& path, bool compact = true) { check(mdb_env_copy2(_env, path.c_str(), compact ? MDB_CP_COMPACT : 0)); }
+    void copy(mdb_filehandle_t fd, bool compact = true) { check(mdb_env_copyfd2(_env, fd, compact ? MDB_CP_COMPACT : 0)); }
+
+    MDB_stat stat() const { MDB_stat s; check(mdb_env_stat(_env, &s)); return s; }
+    MDB_envinfo info() const { MDB_envinfo i; check(mdb_env_info(_env, &i)); return i; }
+
+    unsigned int maxreaders() const { unsigned int n; check(mdb_env_get_maxreaders(_env, &n)); return n; }
+
+    // frees the reader slots of dead processes, returns how many were freed
+    int reader_check() { int dead = 0; check(mdb_reader_check(_env, &dead)); return dead; }
+
+    // reader slots in use by any process, parsed from mdb_reader_list
+    std::vector<ReaderInfo> readers() const
+    {
+        std::vector<ReaderInfo> readers;
+        check(mdb_reader_list(_env, [](const char* msg, void* ctx) -> int
+        {
+            ReaderInfo r;
+            char txnid[32];
+            // the header line and "(no active readers)" don't parse
+            if (std::sscanf(msg, "%d %zx %31s", &r.pid, &r.thread, txnid) == 3)
+            {
+                r.txnid = txnid[0] == '-' ? 0 : std::strtoull(txnid, nullptr, 10);
+                ((std::vector<ReaderInfo>*)ctx)->push_back(r);
+            }
+            return 0;
+        }, &readers));
+        return readers;
+    }
+
+    // Grows the map as configured in EnvArgs::growth, returns false once at the ceiling.
+    // Waits up to EnvArgs::Growth::wait for all of this process' transactions to end
+    // and returns false if they don't, so a caller (or a thread it waits on) holding
+    // one open gets its MapFullError back instead of a deadlock. with_write_txn()
+    // does this on MapFullError.
+    bool grow()
+    {
+        if (_growth.max == 0 || !_resize_gate.close(_growth.wait))
+            return false;
+        Reopen reopen{_resize_gate};
+        size_t size = mapsize();
+        if (size >= _growth.max)
+            return false;
+        size_t next = _growth.step > 0 ? size + _growth.step : (size_t)(size * std::max(_growth.factor, 1.0));
+        check(mdb_env_set_mapsize(_env, std::clamp(next, size + 1, _growth.max)));
+        return true;
+    }
+
+    // Picks up a map size another process has grown to, after MapResizedError.
+    // Returns false if it can't: without growth transactions aren't counted,
+    // so there's no telling none is open, or they didn't end within
+    // EnvArgs::Growth::wait. The caller then rethrows the error.
+    bool adopt_mapsize()
+    {
+        if (_growth.max == 0 || !_resize_gate.close(_growth.wait))
+            return false;
+        Reopen reopen{_resize_gate};
+        check(mdb_env_set_mapsize(_env, 0));
+        return true;
+    }
+
+    // passed by every Txn while growth is enabled, so the map is never moved under it
+    ResizeGate* resize_gate() { return _growth.max > 0 ? &_resize_gate : nullptr; }
+
+    // latency histograms and error counts of the process, plus the age of this
+    // Env's open read-only transactions; empty unless built with LMDBPP_METRICS
+    lmdbpp::metrics::Snapshot metrics() { return metrics::snapshot(_reader_ages); }
+    metrics::ReaderAges& reader_ages() { return _reader_ages; }
+
+    // Bloom filter of a dbi's keys, consulted by Txn::get() and friends before
+    // they look a key up and fed by Txn::put(), see filter.h
+    BloomFilter* filter(MDB_dbi dbi) const { return dbi < _filter_slots ? _filters[dbi].load(std::memory_order_acquire) : nullptr; }
+    void set_filter(MDB_dbi dbi, BloomFilter* filter)
+    {
+        if (dbi >= _filter_slots)
+            check(EINVAL);
+        _filters[dbi].store(filter, std::memory_order_release);
+    }
+
+    // log write transactions record their changes into, see changelog.h
+    ChangeLog* change_log() const { return _change_log.load(std::memory_order_acquire); }
+    void set_change_log(ChangeLog* log) { _change_log.store(log, std::memory_order_release); }
+
 private:
+    struct Reopen
+    {
+        ResizeGate& gate;
+        ~Reopen() { gate.open(); }
+    };
+
     void set_maxreaders(unsigned int readers) { check(mdb_env_set_maxreaders(_env, readers)); }
     MDB_env* _env = nullptr;
+    EnvArgs::Growth _growth;
+    ResizeGate _resize_gate;
+    metrics::ReaderAges _reader_ages;
+    const MDB_dbi _filter_slots;
+    std::unique_ptr<std::atomic<BloomFilter*>[]> _filters;
+    std::atomic<ChangeLog*> _change_log{nullptr};
 };
 
 }  // namespace lmdbpp
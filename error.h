@@ -3,6 +3,7 @@
 
 #include <lmdb.h>
 #include <stdexcept>
+#include "metrics.h"
 
 namespace lmdbpp
 {
@@ -48,6 +49,7 @@ void check(int return_code)
     {
         return;
     }
+    metrics::error(return_code);
     switch (return_code)
     {
         case  MDB_KEYEXIST:          throw KeyExistsError(return_code);        break;
@@ -76,6 +78,17 @@ void check(int return_code)
 }
 // clang-format on
 
+// like check(), but reports MDB_NOTFOUND as false instead of throwing
+inline bool check_found(int return_code)
+{
+    if (return_code == MDB_NOTFOUND)
+    {
+        return false;
+    }
+    check(return_code);
+    return true;
+}
+
 }
 
 #endif
@@ -0,0 +1,139 @@
+#ifndef __lmdbpp_filter_h
+#define __lmdbpp_filter_h
+
+#include <lmdb.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+#include "lmdbpp.h"
+#include "bloom.h"
+
+namespace lmdbpp
+{
+
+struct FilterArgs
+{
+    double bits_per_key = 10;       // about 1% false positives
+    double headroom = 2.0;          // sized for this many times the keys there are at build time
+    size_t min_keys = 1024;
+    std::string path{};             // sidecar file the filter is saved to and loaded from, empty for none
+};
+
+// Puts a BloomFilter in front of lookups on a dbi for as long as it lives:
+// Txn::get(), try_get() and get_many() report keys it rules out as missing
+// without touching the map, every put adds its key to it.
+//
+// It's loaded from the sidecar file if that is current, built from a scan of
+// the dbi otherwise, and saved back on destruction. The file records the last
+// transaction it covers, writes made in between force a rebuild.
+//
+// A filter only holds the keys of the state it was built from on, not ones
+// deleted before. Transactions on older snapshots, open before it was
+// attached or rebuilt, skip it and look keys up in the map.
+//
+// The filter only sees writes made through this process' Env, other processes
+// writing to the dbi have to keep a KeyFilter of their own, or it misses keys.
+// Destroy it only after transactions on the dbi have ended.
+class KeyFilter
+{
+public:
+    KeyFilter(Env& env, Dbi dbi, FilterArgs args = FilterArgs{})
+        : _env(env)
+        , _dbi(dbi)
+        , _args(std::move(args))
+    {
+        _attach(true);
+    }
+
+    ~KeyFilter()
+    {
+        try
+        {
+            if (!_args.path.empty())
+                save();
+        }
+        catch (Error&) {}   // the next open rebuilds it
+        _env.set_filter(_dbi, nullptr);
+    }
+
+    KeyFilter(const KeyFilter&) = delete;
+    KeyFilter& operator=(const KeyFilter&) = delete;
+
+    // Writes the filter to FilterArgs::path. Holds the write lock meanwhile,
+    // so it's current as of the last committed transaction.
+    bool save()
+    {
+        Txn txn{_env};
+        // The file is tagged with a txnid only. Under MDB_NOSYNC, MAPASYNC or
+        // NOMETASYNC a crash could roll the env back below it, and another
+        // commit reach the same txnid without its keys in the filter, so the
+        // env is made durable up to the tag first.
+        int rc = mdb_env_sync(_env.mdb_env(), 1);
+        if (rc != 0)
+        {
+            txn.abort();
+            check(rc);
+        }
+        bool ok = _filter->save(_args.path, mdb_txn_id(txn.mdb_txn()) - 1);
+        txn.abort();
+        return ok;
+    }
+
+    // Rescans the dbi into a fresh filter, e.g. once saturated() or after many
+    // deletes (removed() keys still read as maybe present)
+    void rebuild() { _attach(false); }
+
+    bool may_contain(std::string_view key) const { return _filter->may_contain(key); }
+    bool saturated() const { return _filter->saturated(); }
+    const BloomFilter& bloom() const { return *_filter; }
+
+    // whether the filter came from the sidecar file rather than a scan
+    bool loaded() const { return _loaded; }
+
+private:
+    // loads or builds the filter and attaches it, all inside a write
+    // transaction so no write can slip in between
+    void _attach(bool load)
+    {
+        Txn txn{_env};
+        std::unique_ptr<BloomFilter> filter;
+        _loaded = false;
+        if (load && !_args.path.empty())
+        {
+            uint64_t tag = 0;
+            filter = BloomFilter::load(_args.path, tag);
+            _loaded = filter && tag == mdb_txn_id(txn.mdb_txn()) - 1;
+            if (!_loaded)
+                filter.reset();
+        }
+        if (!filter)
+        {
+            size_t keys = std::max(_args.min_keys, (size_t)(txn.stat(_dbi).ms_entries * _args.headroom));
+            filter = std::make_unique<BloomFilter>(keys, _args.bits_per_key);
+            Cursor c = Cursor::borrow(txn, _dbi);
+            KeyVal<const char, const char> kv;
+            for (bool ok = c.try_first(kv); ok; ok = c.try_next_nodup(kv))
+                filter->add(kv.key.mdb_val());
+        }
+        // covers what the scan (or the file, current as of now) saw and later
+        filter->set_since(mdb_txn_id(txn.mdb_txn()) - 1);
+        _env.set_filter(_dbi, filter.get());
+        txn.abort();
+        // readers may still be looking at the one replaced
+        if (_filter)
+            _retired.push_back(std::move(_filter));
+        _filter = std::move(filter);
+    }
+
+    Env& _env;
+    const Dbi _dbi;
+    const FilterArgs _args;
+    std::unique_ptr<BloomFilter> _filter;
+    std::vector<std::unique_ptr<BloomFilter>> _retired;
+    bool _loaded = false;
+};
+
+}  // namespace lmdbpp
+
+#endif
@@ -0,0 +1,333 @@
+#ifndef __lmdbpp_index_h
+#define __lmdbpp_index_h
+
+#include <lmdb.h>
+#include <algorithm>
+#include <functional>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "lmdbpp.h"
+#include "codec.h"
+
+namespace lmdbpp
+{
+
+// Secondary index over a Table<K, V>: a DUPSORT dbi mapping every key the
+// extractor finds in a value to the primary keys of the values it was found
+// in (DUPFIXED too when primary keys are fixed width). Values are looked up
+// by attribute with a seek in the index instead of a scan of the table.
+//
+// The extractor appends a value's index keys, any number of them, duplicates
+// are fine. I has to own its bytes (no std::string_view), keys are extracted
+// before either dbi is written to. Keep it in step with the table through an
+// IndexedTable, or by calling update() for every write yourself.
+template <typename I, typename K, typename V>
+class Index
+{
+public:
+    typedef std::function<void(const V&, std::vector<I>&)> Extractor;
+
+    Index(Dbi dbi, Extractor extract) : _dbi(dbi), _extract(std::move(extract)) {}
+
+    static Index open(Txn& txn, const char* name, Extractor extract, DbiFlags flags = DbiFlags::CREATE)
+    {
+        flags = flags | DbiFlags::DUPSORT;
+        if constexpr (std::is_arithmetic_v<K>)
+            flags = flags | DbiFlags::DUPFIXED;
+        return Index{txn.open_dbi(name, flags), std::move(extract)};
+    }
+
+    Dbi dbi() const { return _dbi; }
+
+    // Moves key's entries from the index keys of old to the ones of now,
+    // either nullptr for no value. Entries both have are left alone.
+    void update(Txn& txn, const K& key, const V* old, const V* now)
+    {
+        std::vector<I> gone, added;
+        if (old)
+            _extract(*old, gone);
+        if (now)
+            _extract(*now, added);
+        EncodedKey<K> pk{key};
+        for (const I& i : gone)
+        {
+            if (std::find(added.begin(), added.end(), i) != added.end())
+                continue;
+            EncodedKey<I> ik{i};
+            if (check_found(mdb_del(txn.mdb_txn(), _dbi, ik.val().mdb_val(), pk.val().mdb_val())))
+                txn.note_del(_dbi, ik.val().mdb_val(), pk.val().mdb_val());
+        }
+        for (const I& i : added)
+        {
+            if (std::find(gone.begin(), gone.end(), i) != gone.end())
+                continue;
+            EncodedKey<I> ik{i};
+            int rc = mdb_put(txn.mdb_txn(), _dbi, ik.val().mdb_val(), pk.val().mdb_val(), MDB_NODUPDATA);
+            if (rc == MDB_KEYEXIST)
+                continue;
+            check(rc);
+            txn.note_put(_dbi, ik.val().mdb_val(), pk.val().mdb_val(), 0);
+        }
+    }
+
+    // Empties the index and fills it from a scan of table, e.g. after
+    // adding an index to a table that already has values. EINVAL for a
+    // DUPSORT table, see IndexedTable.
+    void rebuild(Txn& txn, Table<K, V>& table)
+    {
+        if (table.dupsort())
+            check(EINVAL);
+        // through a Cursor, so filters and the change log see the deletes
+        Cursor c{txn, _dbi};
+        KeyVal<const char, const char> kv;
+        while (c.try_first(kv))
+            c.del(true);
+        for (const auto& [key, val] : table.range(txn, std::nullopt, std::nullopt))
+            update(txn, key, nullptr, &val);
+    }
+
+    // number of values with index key i
+    size_t count(Txn& txn, const I& i)
+    {
+        EncodedKey<I> ik{i};
+        Cursor c = Cursor::borrow(txn, _dbi);
+        if (!c.try_seek(ik.val()))
+            return 0;
+        size_t n = 0;
+        check(mdb_cursor_count(c.mdb_cursor(), &n));
+        return n;
+    }
+
+    // Values found through the index, decoded as std::pair<K, V>. Primary
+    // keys are collected from the index `batch` at a time, sorted and
+    // resolved with one Txn::get_many() sweep over the table: results come
+    // in index key order between batches and in primary key order within
+    // one. A value with several index keys in range comes once per key,
+    // index entries whose value is gone are skipped.
+    class Lookup
+    {
+    public:
+        class iterator
+        {
+        public:
+            typedef std::pair<K, V> value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef std::input_iterator_tag iterator_concept;
+
+            iterator() = default;
+            iterator(Lookup* lookup) : _lookup(lookup) {}
+
+            value_type operator*() const { return _lookup->_current(); }
+            iterator& operator++() { _lookup->_advance(); return *this; }
+            void operator++(int) { ++*this; }
+            friend bool operator==(const iterator& it, std::default_sentinel_t) { return it._at_end(); }
+
+        private:
+            bool _at_end() const { return _lookup == nullptr || _lookup->_at_end(); }
+
+            Lookup* _lookup = nullptr;
+        };
+
+        Lookup(Txn& txn, Dbi index, Dbi primary, const std::optional<I>& lo, const std::optional<I>& hi, bool exact, size_t batch)
+            : _txn(txn)
+            , _index(index)
+            , _primary(primary)
+            , _c{Cursor::borrow(txn, index)}
+            , _exact(exact)
+            , _batch(std::max<size_t>(1, batch))
+        {
+            if (lo)
+                _lo.emplace(*lo);
+            if (hi)
+                _hi.emplace(*hi);
+        }
+        Lookup(const Lookup&) = delete;
+
+        iterator begin()
+        {
+            _started = false;
+            _done = false;
+            _fill();
+            return iterator{this};
+        }
+        std::default_sentinel_t end() { return {}; }
+
+    private:
+        // next primary key from the index, false past the last one in range
+        bool _next(Val<const char>& pk)
+        {
+            if (_done)
+                return false;
+            KeyVal<const char, const char> kv;
+            bool ok;
+            if (!_started)
+            {
+                _started = true;
+                if (_lo)
+                {
+                    kv.key = _lo->val();
+                    ok = _c.try_seek_range(kv);
+                }
+                else
+                {
+                    ok = _c.try_first(kv);
+                }
+            }
+            else
+            {
+                ok = _c.try_next(kv);
+            }
+            if (ok && _exact)
+                ok = _txn.compare(_index, kv.key, _lo->val()) == 0;
+            if (ok && _hi)
+                ok = _txn.compare(_index, kv.key, _hi->val()) < 0;
+            _done = !ok;
+            if (ok)
+                pk = kv.val;
+            return ok;
+        }
+
+        // the next batch with anything left in it, or none
+        void _fill()
+        {
+            do
+            {
+                _resolve();
+            }
+            while (_keys.empty() && !_done);
+        }
+
+        void _resolve()
+        {
+            _keys.clear();
+            _pos = 0;
+            Val<const char> pk;
+            while (_keys.size() < _batch && _next(pk))
+                _keys.push_back(pk);
+            std::sort(_keys.begin(), _keys.end(), [this](const Val<const char>& a, const Val<const char>& b) { return _txn.compare(_primary, a, b) < 0; });
+            _vals.assign(_keys.size(), Val<const char>{});
+            _txn.get_many<const char, char>(_primary, std::span<const Val<const char>>{_keys}, std::span<Val<const char>>{_vals}, true);
+            // drop what's missing from the table
+            size_t kept = 0;
+            for (size_t i = 0; i < _keys.size(); ++i)
+            {
+                if (_vals[i].data() == nullptr)
+                    continue;
+                _keys[kept] = _keys[i];
+                _vals[kept] = _vals[i];
+                ++kept;
+            }
+            _keys.resize(kept);
+            _vals.resize(kept);
+        }
+
+        void _advance()
+        {
+            if (++_pos == _keys.size())
+                _fill();
+        }
+
+        bool _at_end() const { return _pos >= _keys.size(); }
+        std::pair<K, V> _current() const { return {decode<K>(_keys[_pos]), decode<V>(_vals[_pos])}; }
+
+        Txn& _txn;
+        const Dbi _index;
+        const Dbi _primary;
+        Cursor _c;
+        std::optional<EncodedKey<I>> _lo, _hi;
+        const bool _exact;
+        const size_t _batch;
+        bool _started = false;
+        bool _done = false;
+        std::vector<Val<const char>> _keys;     // primary keys of the current batch, pointing into the map
+        std::vector<Val<const char>> _vals;
+        size_t _pos = 0;
+    };
+
+    // values with index key i
+    Lookup find(Txn& txn, Table<K, V>& table, const I& i, size_t batch = 256)
+    {
+        return Lookup{txn, _dbi, table.dbi(), i, std::nullopt, true, batch};
+    }
+
+    // values with index keys in [lo, hi), unbounded sides are std::nullopt
+    Lookup range(Txn& txn, Table<K, V>& table, const std::optional<I>& lo, const std::optional<I>& hi, size_t batch = 256)
+    {
+        return Lookup{txn, _dbi, table.dbi(), lo, hi, false, batch};
+    }
+
+private:
+    Dbi _dbi;
+    Extractor _extract;
+};
+
+// A Table that keeps its attached indexes up to date in the same
+// transaction as every put(), overwrite() and del() it makes. Only for
+// tables with one value per key: an index entry names a primary key, not
+// one of its duplicates, so DUPSORT tables are rejected with EINVAL.
+template <typename K, typename V>
+class IndexedTable
+{
+public:
+    IndexedTable(Table<K, V> table) : _table(table)
+    {
+        if (_table.dupsort())
+            check(EINVAL);
+    }
+
+    // index has to outlive this
+    template <typename I>
+    void attach(Index<I, K, V>& index)
+    {
+        _indexes.push_back([&index](Txn& txn, const K& key, const V* old, const V* now) { index.update(txn, key, old, now); });
+    }
+
+    Table<K, V>& table() { return _table; }
+    Dbi dbi() const { return _table.dbi(); }
+
+    std::optional<V> get(Txn& txn, const K& key) { return _table.get(txn, key); }
+
+    // throws KeyExistsError before touching an index if key exists
+    void put(Txn& txn, const K& key, const V& val)
+    {
+        _table.put(txn, key, val);
+        _update(txn, key, nullptr, &val);
+    }
+
+    void overwrite(Txn& txn, const K& key, const V& val)
+    {
+        std::optional<V> old;
+        if (!_indexes.empty())
+            old = _table.get(txn, key);
+        _update(txn, key, old ? &*old : nullptr, &val);
+        _table.overwrite(txn, key, val);
+    }
+
+    bool del(Txn& txn, const K& key)
+    {
+        if (_indexes.empty())
+            return _table.del(txn, key);
+        std::optional<V> old = _table.get(txn, key);
+        if (!old)
+            return false;
+        _update(txn, key, &*old, nullptr);
+        return _table.del(txn, key);
+    }
+
+private:
+    void _update(Txn& txn, const K& key, const V* old, const V* now)
+    {
+        for (auto& update : _indexes)
+            update(txn, key, old, now);
+    }
+
+    Table<K, V> _table;
+    std::vector<std::function<void(Txn&, const K&, const V*, const V*)>> _indexes;
+};
+
+}  // namespace lmdbpp
+
+#endif
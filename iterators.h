@@ -1,6 +1,13 @@
 #ifndef __lmdbpp_iterators
 #define __lmdbpp_iterators
 
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
 #include "lmdbpp.h"
 
 namespace lmdbpp::iterators
@@ -68,27 +75,16 @@ class KeyValNextable
 {
 public:
 
-    KeyValNextable(Txn& txn, Dbi dbi) : _c{txn, dbi} {}
+    KeyValNextable(Txn& txn, Dbi dbi) : _c{Cursor::borrow(txn, dbi)} {}
 
     bool next(KeyVal<const TKey, const TVal>& out)
     {
-        try
+        if (_first)
         {
-            if (_first)
-            {
-                _c.first(out);
-                _first = false;
-            }
-            else
-            {
-                _c.next(out);
-            }
-            return true;
-        }
-        catch (NotFoundError& e)
-        {
-            return false;
+            _first = false;
+            return _c.try_first(out);
         }
+        return _c.try_next(out);
     }
 private:
     bool _first = true;
@@ -97,75 +93,242 @@ private:
 template <typename TKey, typename TVal> using KeyValIterator = OwningNextIteratable<KeyValNextable<TKey, TVal>, KeyVal<const TKey, const TVal>>;
 
 
+// Yields the duplicates of a DUPFIXED key a page at a time (MDB_GET_MULTIPLE,
+// MDB_NEXT_MULTIPLE) as std::span<const TVal>, pointing straight into the map.
+// Small duplicate sets live in a sub-page inside their node, which has no
+// alignment guarantee, those few are copied to an aligned buffer first.
 template <typename TKey, typename TVal>
 class MultiValNextable
 {
 public:
-    MultiValNextable(Txn& txn, Dbi dbi, const Val<TKey>& key) : _c{txn, dbi}, _key(key) {}
+    MultiValNextable(Txn& txn, Dbi dbi, const Val<TKey>& key) : _c{Cursor::borrow(txn, dbi)}, _key(key) {}
 
-    bool next(Val<const TVal>& out)
+    bool next(std::span<const TVal>& out)
     {
-        try
+        Val<const TVal> page;
+        bool found;
+        if (_first)
         {
-            if (_first)
-            {
-                _c.seek(_key);
-                _c.get_multiple(_key, out);
-                _first = false;
-            }
-            else
-            {
-                _c.next_multiple(_key, out);
-            }
-            return true;
+            _first = false;
+            found = _c.try_seek(_key) && _c.try_get_multiple(_key, page);
         }
-        catch (NotFoundError& e)
+        else
         {
+            found = _c.try_next_multiple(_key, page);
+        }
+        if (!found)
             return false;
+
+        size_t n = page.size() / sizeof(TVal);
+        if ((uintptr_t)page.data() % alignof(TVal) == 0)
+        {
+            out = {page.data(), n};
+            return true;
         }
+        _aligned.resize(n);
+        std::memcpy(_aligned.data(), page.data(), n * sizeof(TVal));
+        out = {_aligned.data(), n};
+        return true;
     }
 
 private:
     Cursor _c;
     Val<TKey> _key;
     bool _first = true;
+    std::vector<TVal> _aligned;
 };
-template <typename TKey, typename TVal> using MultiValIterator = OwningNextIteratable<MultiValNextable<TKey, const TVal>, Val<const TVal>>;
+template <typename TKey, typename TVal> using MultiValIterator = OwningNextIteratable<MultiValNextable<TKey, TVal>, std::span<const TVal>>;
 
 template <typename TKey, typename TVal>
 class DupValNextable
 {
 public:
-    DupValNextable(Txn& txn, Dbi dbi, const Val<TKey>& key) : _c{txn, dbi}, _key(key) {}
+    DupValNextable(Txn& txn, Dbi dbi, const Val<TKey>& key) : _c{Cursor::borrow(txn, dbi)}, _key(key) {}
 
     bool next(Val<const TVal>& out)
     {
-        try
+        if (_first)
+        {
+            _first = false;
+            return _c.try_seek(_key) && _c.try_first_dup(_key, out);
+        }
+        return _c.try_next_dup(_key, out);
+    }
+
+private:
+    Cursor _c;
+    Val<TKey> _key;
+    bool _first = true;
+};
+template <typename TKey, typename TVal> using DupValIterator = OwningNextIteratable<DupValNextable<TKey, TVal>, Val<const TVal>>;
+
+
+enum class Order
+{
+    FORWARD,
+    REVERSE
+};
+
+// Single pass view over the keys in [lo, hi) of a dbi, in either direction.
+// Seeks straight to the first key with MDB_SET_RANGE and stops at the other
+// bound, one comparison per step. Models std::ranges::input_range.
+// The bounds are not copied and have to outlive the range.
+template <typename TKey, typename TVal>
+class KeyRange
+{
+public:
+    typedef KeyVal<const TKey, const TVal> value_type;
+    typedef std::optional<Val<const TKey>> Bound;
+
+    class iterator
+    {
+    public:
+        typedef KeyRange::value_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::input_iterator_tag iterator_concept;
+
+        iterator() = default;
+        iterator(KeyRange* range) : _range(range) {}
+
+        const value_type& operator*() const { return _range->_kv; }
+        const value_type* operator->() const { return &_range->_kv; }
+
+        iterator& operator++()
+        {
+            _range->_advance();
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+
+        friend bool operator==(const iterator& it, std::default_sentinel_t) { return it._at_end(); }
+
+    private:
+        bool _at_end() const { return _range == nullptr || _range->_end; }
+
+        KeyRange* _range = nullptr;
+    };
+
+    // unbounded sides are std::nullopt
+    KeyRange(Txn& txn, Dbi dbi, Bound lo, Bound hi, Order order = Order::FORWARD, bool unique_keys = false)
+        : _txn(txn)
+        , _dbi(dbi)
+        , _c{Cursor::borrow(txn, dbi)}
+        , _lo(lo)
+        , _hi(hi)
+        , _order(order)
+        , _unique_keys(unique_keys)
+    {
+    }
+
+    static KeyRange all(Txn& txn, Dbi dbi, Order order = Order::FORWARD) { return {txn, dbi, std::nullopt, std::nullopt, order}; }
+
+    // all keys starting with prefix, assumes the default (memcmp) key order
+    static KeyRange prefix(Txn& txn, Dbi dbi, const Val<const TKey>& prefix, Order order = Order::FORWARD)
+    {
+        KeyRange r{txn, dbi, prefix, std::nullopt, order};
+        // the first key past the prefix: strip trailing 0xff bytes and increment the last one
+        r._hi_buf.assign((const char*)prefix.data(), prefix.size());
+        while (!r._hi_buf.empty() && (unsigned char)r._hi_buf.back() == 0xff)
+            r._hi_buf.pop_back();
+        if (!r._hi_buf.empty())
         {
-            if (_first)
+            ++r._hi_buf.back();
+            r._hi_from_buf();
+        }
+        return r;
+    }
+
+    KeyRange(KeyRange&& o)
+        : _txn(o._txn)
+        , _dbi(o._dbi)
+        , _c{std::move(o._c)}
+        , _lo(o._lo)
+        , _hi(o._hi)
+        , _hi_buf(std::move(o._hi_buf))
+        , _order(o._order)
+        , _unique_keys(o._unique_keys)
+    {
+        // _hi may point into the moved buffer, which does not survive small string moves
+        if (!_hi_buf.empty())
+            _hi_from_buf();
+    }
+
+    iterator begin()
+    {
+        _start();
+        return iterator{this};
+    }
+    std::default_sentinel_t end() { return {}; }
+
+private:
+    void _hi_from_buf()
+    {
+        _hi.emplace();
+        _hi->set((const TKey*)_hi_buf.data(), _hi_buf.size());
+    }
+
+    void _start()
+    {
+        if (_order == Order::FORWARD)
+        {
+            if (_lo)
             {
-                _c.seek(_key);
-                _c.first_dup(_key, out);
-                _first = false;
+                _kv.key = *_lo;
+                _end = !_c.try_seek_range(_kv);
             }
             else
             {
-                _c.next_dup(_key, out);
+                _end = !_c.try_first(_kv);
             }
-            return true;
         }
-        catch (NotFoundError& e)
+        else
         {
-            return false;
+            if (_hi)
+            {
+                // the last key < hi is right before the first key >= hi
+                _kv.key = *_hi;
+                _end = !(_c.try_seek_range(_kv) ? _c.try_prev(_kv) : _c.try_last(_kv));
+            }
+            else
+            {
+                _end = !_c.try_last(_kv);
+            }
         }
+        _check_bound();
     }
 
-private:
+    void _advance()
+    {
+        bool found;
+        if (_order == Order::FORWARD)
+            found = _unique_keys ? _c.try_next_nodup(_kv) : _c.try_next(_kv);
+        else
+            found = _unique_keys ? _c.try_prev_nodup(_kv) : _c.try_prev(_kv);
+        _end = !found;
+        _check_bound();
+    }
+
+    void _check_bound()
+    {
+        if (_end)
+            return;
+        if (_order == Order::FORWARD)
+            _end = _hi && _txn.compare(_dbi, _kv.key, *_hi) >= 0;
+        else
+            _end = _lo && _txn.compare(_dbi, _kv.key, *_lo) < 0;
+    }
+
+    Txn& _txn;
+    Dbi _dbi;
     Cursor _c;
-    Val<TKey> _key;
-    bool _first = true;
+    Bound _lo;
+    Bound _hi;
+    std::string _hi_buf;
+    Order _order;
+    bool _unique_keys;
+    value_type _kv;
+    bool _end = true;
 };
-template <typename TKey, typename TVal> using DupValIterator = OwningNextIteratable<DupValNextable<TKey, TVal>, Val<const TVal>>;
 
 
 }  // namespace lmdbpp
@@ -6,5 +6,6 @@
 #include "env.h"
 #include "txn.h"
 #include "cursor.h"
+#include "pool.h"
 
 #endif
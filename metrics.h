@@ -0,0 +1,326 @@
+#ifndef __lmdbpp_metrics_h
+#define __lmdbpp_metrics_h
+
+#include <lmdb.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Opt-in instrumentation: define LMDBPP_METRICS (in every translation unit alike)
+// to record latency histograms for transactions, gets, puts, dels and cursor
+// ops, error counts from check() and the age of live read-only transactions.
+// Without it the hooks are empty and compile away, Env::metrics() returns an
+// empty Snapshot.
+namespace lmdbpp::metrics
+{
+
+enum class Op
+{
+    TXN_BEGIN,
+    TXN_COMMIT,
+    TXN_ABORT,
+    GET,
+    PUT,
+    DEL,
+    CURSOR_GET,
+    CURSOR_PUT,
+    CURSOR_DEL,
+    COUNT
+};
+constexpr const char* op_names[] = {"txn_begin", "txn_commit", "txn_abort", "get", "put", "del", "cursor_get", "cursor_put", "cursor_del"};
+constexpr size_t op_count = (size_t)Op::COUNT;
+
+// one slot per MDB_* error code, the last one for everything else (errno values)
+constexpr size_t error_slots = MDB_LAST_ERRCODE - MDB_KEYEXIST + 2;
+constexpr size_t error_slot(int rc) { return rc >= MDB_KEYEXIST && rc <= MDB_LAST_ERRCODE ? rc - MDB_KEYEXIST : error_slots - 1; }
+
+// Log-linear buckets like HdrHistogram: exact below 16, above that 16 buckets
+// per power of two, so any recorded value is off by at most 1/16.
+struct Histogram
+{
+    static constexpr int sub_bits = 4;
+    static constexpr size_t sub_count = 1 << sub_bits;
+    static constexpr size_t buckets = (64 - sub_bits + 1) << sub_bits;
+
+    static constexpr size_t bucket(uint64_t v)
+    {
+        if (v < sub_count)
+            return v;
+        int shift = 63 - std::countl_zero(v) - sub_bits;
+        return ((size_t)(shift + 1) << sub_bits) + ((v >> shift) & (sub_count - 1));
+    }
+    static constexpr uint64_t lower_bound(size_t b)
+    {
+        if (b < sub_count)
+            return b;
+        return (uint64_t)(sub_count + (b & (sub_count - 1))) << ((b >> sub_bits) - 1);
+    }
+
+    std::array<uint64_t, buckets> counts{};
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+
+    void record(uint64_t v)
+    {
+        ++counts[bucket(v)];
+        ++count;
+        sum += v;
+        max = std::max(max, v);
+    }
+
+    void merge(const Histogram& o)
+    {
+        for (size_t b = 0; b < buckets; ++b)
+            counts[b] += o.counts[b];
+        count += o.count;
+        sum += o.sum;
+        max = std::max(max, o.max);
+    }
+
+    // lower bound of the bucket holding the p-th fraction (0..1) of values
+    uint64_t percentile(double p) const
+    {
+        uint64_t rank = (uint64_t)(p * count), seen = 0;
+        for (size_t b = 0; b < buckets; ++b)
+        {
+            seen += counts[b];
+            if (seen > rank)
+                return std::min(lower_bound(b), max);
+        }
+        return max;
+    }
+
+    double mean() const { return count ? (double)sum / count : 0; }
+};
+
+struct Snapshot
+{
+    bool enabled = false;
+    std::array<Histogram, op_count> latency_ns;     // per Op, process wide
+    std::array<uint64_t, error_slots> errors{};     // exceptions thrown by check(), process wide
+    std::vector<std::chrono::nanoseconds> read_txn_ages;   // live read-only transactions of the Env, oldest first
+
+    const Histogram& operator[](Op op) const { return latency_ns[(size_t)op]; }
+    uint64_t errors_of(int rc) const { return errors[error_slot(rc)]; }
+};
+
+#ifdef LMDBPP_METRICS
+
+typedef std::chrono::steady_clock clock;
+
+// counters of one thread, only ever written by that thread, so relaxed
+// load/store pairs suffice and no cache line is shared between writers
+struct ThreadCounters
+{
+    std::array<std::array<std::atomic<uint64_t>, Histogram::buckets>, op_count> counts{};
+    std::array<std::atomic<uint64_t>, op_count> sum{};
+    std::array<std::atomic<uint64_t>, op_count> max{};
+    std::array<std::atomic<uint64_t>, error_slots> errors{};
+
+    static void bump(std::atomic<uint64_t>& a, uint64_t by = 1) { a.store(a.load(std::memory_order_relaxed) + by, std::memory_order_relaxed); }
+
+    void record(Op op, uint64_t ns)
+    {
+        size_t i = (size_t)op;
+        bump(counts[i][Histogram::bucket(ns)]);
+        bump(sum[i], ns);
+        if (ns > max[i].load(std::memory_order_relaxed))
+            max[i].store(ns, std::memory_order_relaxed);
+    }
+
+    void add_to(Snapshot& s) const
+    {
+        for (size_t i = 0; i < op_count; ++i)
+        {
+            Histogram h;
+            for (size_t b = 0; b < Histogram::buckets; ++b)
+            {
+                h.counts[b] = counts[i][b].load(std::memory_order_relaxed);
+                h.count += h.counts[b];
+            }
+            h.sum = sum[i].load(std::memory_order_relaxed);
+            h.max = max[i].load(std::memory_order_relaxed);
+            s.latency_ns[i].merge(h);
+        }
+        for (size_t e = 0; e < error_slots; ++e)
+            s.errors[e] += errors[e].load(std::memory_order_relaxed);
+    }
+};
+
+// every thread's counters, plus the totals of threads that already exited
+class Registry
+{
+public:
+    ThreadCounters* attach()
+    {
+        std::lock_guard lock{_mutex};
+        _threads.push_back(new ThreadCounters);
+        return _threads.back();
+    }
+
+    void detach(ThreadCounters* t)
+    {
+        std::lock_guard lock{_mutex};
+        t->add_to(_exited);
+        std::erase(_threads, t);
+        delete t;
+    }
+
+    void add_to(Snapshot& s)
+    {
+        std::lock_guard lock{_mutex};
+        for (size_t i = 0; i < op_count; ++i)
+            s.latency_ns[i].merge(_exited.latency_ns[i]);
+        for (size_t e = 0; e < error_slots; ++e)
+            s.errors[e] += _exited.errors[e];
+        for (ThreadCounters* t : _threads)
+            t->add_to(s);
+    }
+
+private:
+    std::mutex _mutex;
+    std::vector<ThreadCounters*> _threads;
+    Snapshot _exited;
+};
+
+inline Registry& registry()
+{
+    static Registry r;
+    return r;
+}
+
+inline ThreadCounters& local()
+{
+    thread_local struct Attached
+    {
+        ThreadCounters* counters = registry().attach();
+        ~Attached() { registry().detach(counters); }
+    } attached;
+    return *attached.counters;
+}
+
+inline void error(int rc) { ThreadCounters::bump(local().errors[error_slot(rc)]); }
+
+// records the time until it goes out of scope
+class Timer
+{
+public:
+    Timer(Op op) : _op(op), _start(clock::now()) {}
+    ~Timer() { local().record(_op, std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - _start).count()); }
+
+private:
+    Op _op;
+    clock::time_point _start;
+};
+
+// Read-only transactions currently open on an Env, and since when. A table
+// of atomic slots hashed by txn pointer, so begin/end take no lock and share
+// no cache line unless two txns land in the same slot. A txn is kept in one
+// of the `probes` slots from its hash, if all are taken it goes untracked.
+// end() is called for write txns too, and a miss costs `probes` loads.
+class ReaderAges
+{
+public:
+    static constexpr size_t slots = 1024;
+    static constexpr size_t probes = 16;
+
+    void begin(const MDB_txn* txn)
+    {
+        size_t start = _hash(txn);
+        for (size_t i = 0; i < probes; ++i)
+        {
+            Slot& s = _slots[(start + i) % slots];
+            const MDB_txn* expected = nullptr;
+            if (s.txn.load(std::memory_order_relaxed) == nullptr && s.txn.compare_exchange_strong(expected, txn, std::memory_order_acquire))
+            {
+                s.since.store(clock::now().time_since_epoch().count(), std::memory_order_release);
+                return;
+            }
+        }
+    }
+
+    void end(const MDB_txn* txn)
+    {
+        size_t start = _hash(txn);
+        for (size_t i = 0; i < probes; ++i)
+        {
+            Slot& s = _slots[(start + i) % slots];
+            if (s.txn.load(std::memory_order_relaxed) == txn)
+            {
+                s.since.store(0, std::memory_order_relaxed);
+                s.txn.store(nullptr, std::memory_order_release);
+                return;
+            }
+        }
+    }
+
+    // a slot being claimed or released concurrently may be missed
+    std::vector<std::chrono::nanoseconds> ages()
+    {
+        auto now = clock::now().time_since_epoch().count();
+        std::vector<std::chrono::nanoseconds> ages;
+        for (Slot& s : _slots)
+        {
+            if (s.txn.load(std::memory_order_acquire) == nullptr)
+                continue;
+            int64_t since = s.since.load(std::memory_order_acquire);
+            if (since != 0)
+                ages.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::duration{now - since}));
+        }
+        std::sort(ages.rbegin(), ages.rend());
+        return ages;
+    }
+
+private:
+    struct alignas(64) Slot
+    {
+        std::atomic<const MDB_txn*> txn{nullptr};
+        std::atomic<int64_t> since{0};  // clock ticks, 0 while being claimed
+    };
+
+    static size_t _hash(const MDB_txn* txn) { return std::hash<const MDB_txn*>{}(txn) / alignof(std::max_align_t) % slots; }
+
+    std::array<Slot, slots> _slots;
+};
+
+inline Snapshot snapshot(ReaderAges& readers)
+{
+    Snapshot s;
+    s.enabled = true;
+    registry().add_to(s);
+    s.read_txn_ages = readers.ages();
+    return s;
+}
+
+#else
+
+inline void error(int) {}
+
+class Timer
+{
+public:
+    Timer(Op) {}
+};
+
+class ReaderAges
+{
+public:
+    void begin(const MDB_txn*) {}
+    void end(const MDB_txn*) {}
+};
+
+inline Snapshot snapshot(ReaderAges&) { return {}; }
+
+#endif
+
+}  // namespace lmdbpp::metrics
+
+#endif
@@ -0,0 +1,94 @@
+// The metrics hooks only exist with LMDBPP_METRICS, which has to be defined
+// alike in every translation unit, so they get a test program of their own.
+#define LMDBPP_METRICS
+
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <thread>
+#include <latch>
+#include <filesystem>
+#include "lmdbpp.h"
+#include <assert.h>
+
+using namespace lmdbpp;
+
+typedef void (*test_func)(Env&);
+
+void latencies(Env& env)
+{
+    Dbi dbi;
+    {
+        Txn txn{env};
+        dbi = txn.open_dbi();
+        txn.put(dbi, Val{"k"}, Val{"v"});
+        txn.commit();
+    }
+    {
+        Txn reader{env, MDB_RDONLY};
+        assert((reader.get<const char, char>(dbi, Val{"k"}).to_str() == "v"));
+        try { reader.get<const char, char>(dbi, Val{"missing"}); assert(false); }
+        catch (NotFoundError&) {}
+    }
+
+    auto s = env.metrics();
+    assert(s.enabled);
+    assert(s[metrics::Op::PUT].count >= 1 && s[metrics::Op::TXN_COMMIT].count >= 1);
+    assert(s[metrics::Op::GET].count >= 2 && s[metrics::Op::TXN_BEGIN].count >= 2);
+    assert(s.errors_of(MDB_NOTFOUND) >= 1);
+    assert(s.read_txn_ages.empty());
+}
+
+void reader_ages(Env& env)
+{
+    {
+        // write txns aren't readers
+        Txn txn{env};
+        assert(env.metrics().read_txn_ages.empty());
+    }
+
+    // one read txn per thread without MDB_NOTLS
+    std::vector<std::thread> threads;
+    std::latch open{9}, close{1};
+    for (int t=0; t<8; ++t)
+    {
+        threads.emplace_back([&]
+        {
+            Txn reader{env, MDB_RDONLY};
+            open.count_down();
+            close.wait();
+        });
+    }
+    open.arrive_and_wait();
+    auto ages = env.metrics().read_txn_ages;
+    assert(ages.size() == 8);
+    assert(std::is_sorted(ages.rbegin(), ages.rend()));
+    close.count_down();
+    for (auto& t : threads)
+        t.join();
+    assert(env.metrics().read_txn_ages.empty());
+
+    // the slots are reused
+    for (int i=0; i<3 * (int)metrics::ReaderAges::slots; ++i)
+        Txn reader{env, MDB_RDONLY};
+    assert(env.metrics().read_txn_ages.empty());
+}
+
+int main()
+{
+    std::string env_path{"test.mdb"};
+
+    std::vector<test_func> tests{
+        latencies,
+        reader_ages
+    };
+    for (auto test : tests)
+    {
+        std::filesystem::remove_all(env_path);
+        std::filesystem::create_directory(env_path);
+        Env env{env_path, {.flags=EnvArgs::Flags::CREATE, .mapsize=1024*1024}};
+        test(env);
+    }
+
+    return 0;
+}
@@ -0,0 +1,185 @@
+#ifndef __lmdbpp_parallel_h
+#define __lmdbpp_parallel_h
+
+#include <lmdb.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <latch>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "lmdbpp.h"
+#include "iterators.h"
+
+namespace lmdbpp
+{
+
+struct ParallelScanArgs
+{
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t min_entries_per_partition = 4096;    // smaller dbis get fewer partitions
+    int max_attempts = 16;                      // for agreeing on one snapshot, see parallel_partitions()
+};
+
+// Picks up to n-1 keys splitting dbi into n roughly equal key ranges without
+// scanning it: the bytes following the common prefix of the first and last key
+// are interpolated linearly and each guess is snapped to a real key with
+// MDB_SET_RANGE. Balance assumes evenly spread keys under memcmp order, the
+// partitions themselves are correct for any comparator.
+inline std::vector<std::string> partition_keys(Txn& txn, Dbi dbi, size_t n)
+{
+    std::vector<std::string> splits;
+    Cursor c = Cursor::borrow(txn, dbi);
+    KeyVal<const char, const char> first, last;
+    if (n < 2 || !c.try_first(first) || !c.try_last(last))
+        return splits;
+
+    std::string_view lo{first.key.data(), first.key.size()}, hi{last.key.data(), last.key.size()};
+    size_t prefix = std::mismatch(lo.begin(), lo.end(), hi.begin(), hi.end()).first - lo.begin();
+    auto number = [prefix](std::string_view key)
+    {
+        uint64_t v = 0;
+        for (size_t i = prefix; i < prefix + sizeof(v); ++i)
+            v = (v << 8) | (i < key.size() ? (unsigned char)key[i] : 0);
+        return v;
+    };
+    uint64_t a = number(lo), b = number(hi);
+    std::string base{lo.substr(0, prefix)};
+
+    for (size_t i = 1; i < n; ++i)
+    {
+        uint64_t guess = a + (uint64_t)((long double)(b - a) * i / n);
+        std::string probe = base;
+        for (int shift = 56; shift >= 0; shift -= 8)
+            probe.push_back((char)(guess >> shift));
+
+        KeyVal<const char, const char> kv;
+        kv.key = Val<const char>{probe};
+        if (!c.try_seek_range(kv))
+            break;
+        // only keep strictly increasing splits past the first key
+        Val<const char> prev = splits.empty() ? first.key : Val<const char>{splits.back()};
+        if (txn.compare(dbi, kv.key, prev) > 0)
+            splits.emplace_back(kv.key.data(), kv.key.size());
+    }
+    return splits;
+}
+
+// Runs fn(partition, KeyRange<TKey, TVal>&) for every partition of dbi, each on
+// its own thread with its own read-only transaction. All transactions are on
+// the same snapshot: a worker that sees a different txn id than the one the
+// partitions were planned on makes everyone start over (up to max_attempts,
+// then BadTxnError). An exception thrown by fn is rethrown to the caller.
+template <typename TKey, typename TVal, typename F>
+void parallel_partitions(Env& env, Dbi dbi, F&& fn, ParallelScanArgs args = ParallelScanArgs{})
+{
+    for (int attempt = 0; attempt < args.max_attempts; ++attempt)
+    {
+        std::vector<std::string> splits;
+        size_t snapshot;
+        {
+            Txn plan{env, MDB_RDONLY};
+            snapshot = mdb_txn_id(plan.mdb_txn());
+            MDB_stat stat;
+            check(mdb_stat(plan.mdb_txn(), dbi, &stat));
+            size_t n = std::min(args.threads, std::max<size_t>(1, stat.ms_entries / std::max<size_t>(1, args.min_entries_per_partition)));
+            splits = partition_keys(plan, dbi, n);
+        }
+
+        size_t partitions = splits.size() + 1;
+        std::latch started{(std::ptrdiff_t)partitions};
+        std::atomic<bool> mismatch{false};
+        std::vector<std::exception_ptr> errors(partitions);
+        std::vector<std::thread> workers;
+
+        for (size_t i = 0; i < partitions; ++i)
+        {
+            workers.emplace_back([&, i]
+            {
+                bool arrived = false;
+                try
+                {
+                    Txn txn{env, MDB_RDONLY};
+                    if (mdb_txn_id(txn.mdb_txn()) != snapshot)
+                        mismatch = true;
+                    arrived = true;
+                    started.arrive_and_wait();
+                    if (mismatch)
+                        return;
+
+                    typename iterators::KeyRange<TKey, TVal>::Bound lo, hi;
+                    if (i > 0)
+                        lo.emplace().set((const TKey*)splits[i - 1].data(), splits[i - 1].size());
+                    if (i < splits.size())
+                        hi.emplace().set((const TKey*)splits[i].data(), splits[i].size());
+                    iterators::KeyRange<TKey, TVal> range{txn, dbi, lo, hi};
+                    fn(i, range);
+                }
+                catch (...)
+                {
+                    errors[i] = std::current_exception();
+                    mismatch = true;
+                    if (!arrived)
+                        started.count_down();
+                }
+            });
+        }
+        for (auto& w : workers)
+            w.join();
+        for (auto& e : errors)
+            if (e)
+                std::rethrow_exception(e);
+        if (!mismatch)
+            return;
+    }
+    throw BadTxnError(MDB_BAD_TXN);
+}
+
+// Calls fn(partition, kv) for every entry of dbi, concurrently from several threads
+template <typename TKey, typename TVal, typename F>
+void parallel_scan(Env& env, Dbi dbi, F&& fn, ParallelScanArgs args = ParallelScanArgs{})
+{
+    parallel_partitions<TKey, TVal>(env, dbi, [&fn](size_t partition, auto& range)
+    {
+        for (auto& kv : range)
+            fn(partition, kv);
+    }, args);
+}
+
+// Folds every partition into its own copy of init with fold(acc, kv), then
+// merges the partition results in key order with combine(acc, std::move(other)),
+// starting from the first one. init is folded into once per partition, so it
+// should be an identity of combine (0 for a sum), as with std::reduce.
+template <typename TKey, typename TVal, typename TAcc, typename FFold, typename FCombine>
+TAcc parallel_reduce(Env& env, Dbi dbi, TAcc init, FFold&& fold, FCombine&& combine, ParallelScanArgs args = ParallelScanArgs{})
+{
+    // fn only ever runs in the attempt that succeeds, so slots are written once
+    // parallel_partitions() makes at least one and at most threads partitions
+    std::vector<std::optional<TAcc>> results(std::max<size_t>(1, args.threads));
+    parallel_partitions<TKey, TVal>(env, dbi, [&](size_t partition, auto& range)
+    {
+        TAcc acc = init;
+        for (auto& kv : range)
+            fold(acc, kv);
+        results[partition] = std::move(acc);
+    }, args);
+
+    std::optional<TAcc> acc;
+    for (auto& r : results)
+    {
+        if (!r)
+            continue;
+        if (acc)
+            combine(*acc, std::move(*r));
+        else
+            acc = std::move(r);
+    }
+    return acc ? std::move(*acc) : std::move(init);
+}
+
+}  // namespace lmdbpp
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef __lmdbpp_pool_h
+#define __lmdbpp_pool_h
+
+#include <lmdb.h>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "error.h"
+#include "env.h"
+#include "txn.h"
+
+namespace lmdbpp
+{
+
+// read-only transaction in reset state, along with the cursors it had cached
+struct ParkedTxn
+{
+    MDB_txn* txn = nullptr;
+    std::vector<CachedCursor> cursors;
+};
+
+// Keeps finished read-only transactions around in reset state (mdb_txn_reset),
+// so the next reader only has to mdb_txn_renew instead of allocating a
+// transaction and acquiring a reader slot.
+//
+// Without MDB_NOTLS the reader slot is bound to the thread that created the
+// transaction, so every thread parks at most one transaction of its own.
+// With MDB_NOTLS any thread may pick up any parked transaction.
+class ReadTxnPool
+{
+public:
+    ReadTxnPool(Env& env, size_t max_idle = 16)
+        : _env(env)
+        , _notls((env.flags() & EnvArgs::Flags::NOTLS) != EnvArgs::Flags::NONE)
+        , _max_idle(max_idle)
+    {
+    }
+
+    ~ReadTxnPool()
+    {
+        for (auto& parked : _idle)
+            _discard(parked);
+        for (auto& [id, parked] : _per_thread)
+            _discard(parked);
+    }
+
+    ReadTxnPool(const ReadTxnPool&) = delete;
+    ReadTxnPool& operator=(const ReadTxnPool&) = delete;
+
+    // returns a running read-only transaction, renewed from the pool if possible.
+    // Cursors parked with it are marked stale and get renewed on first use.
+    ParkedTxn acquire()
+    {
+        ParkedTxn parked = _take();
+        if (parked.txn != nullptr)
+        {
+            if (mdb_txn_renew(parked.txn) == 0)
+                return parked;
+            // e.g. MDB_BAD_RSLOT after the owning thread exited, start over
+            _discard(parked);
+        }
+        check(mdb_txn_begin(_env.mdb_env(), nullptr, MDB_RDONLY, &parked.txn));
+        return parked;
+    }
+
+    // resets the transaction and parks it for reuse, or aborts it if the pool is full
+    void release(ParkedTxn&& parked)
+    {
+        mdb_txn_reset(parked.txn);
+        for (auto& c : parked.cursors)
+            c.stale = true;
+        if (!_park(parked))
+            _discard(parked);
+    }
+
+    Env& env() const { return _env; }
+    bool notls() const { return _notls; }
+
+private:
+    ParkedTxn _take()
+    {
+        std::lock_guard lock{_mutex};
+        ParkedTxn parked;
+        if (_notls)
+        {
+            if (!_idle.empty())
+            {
+                parked = std::move(_idle.back());
+                _idle.pop_back();
+            }
+        }
+        else
+        {
+            auto it = _per_thread.find(std::this_thread::get_id());
+            if (it != _per_thread.end())
+            {
+                parked = std::move(it->second);
+                _per_thread.erase(it);
+            }
+        }
+        return parked;
+    }
+
+    bool _park(ParkedTxn& parked)
+    {
+        std::lock_guard lock{_mutex};
+        if (_notls)
+        {
+            if (_idle.size() >= _max_idle)
+                return false;
+            _idle.push_back(std::move(parked));
+            return true;
+        }
+        if (_per_thread.count(std::this_thread::get_id()) > 0)
+            return false;
+        _per_thread.emplace(std::this_thread::get_id(), std::move(parked));
+        return true;
+    }
+
+    static void _discard(ParkedTxn& parked)
+    {
+        for (auto& c : parked.cursors)
+            mdb_cursor_close(c.cursor);
+        parked.cursors.clear();
+        mdb_txn_abort(parked.txn);
+        parked.txn = nullptr;
+    }
+
+    Env& _env;
+    const bool _notls;
+    const size_t _max_idle;
+    std::mutex _mutex;
+    std::vector<ParkedTxn> _idle;
+    std::unordered_map<std::thread::id, ParkedTxn> _per_thread;
+};
+
+// Read-only transaction borrowed from a ReadTxnPool, handed back on destruction.
+// Usable anywhere a Txn is expected (Cursor, iterators, ...).
+class ReadTxn : public ReadOnlyTxn
+{
+public:
+    ReadTxn(ReadTxnPool& pool)
+        : ReadOnlyTxn(Adopt{}, pool.env(), nullptr)
+        , _pool(&pool)
+    {
+        // renewed only now that Txn holds a pass through the Env's resize gate, if any
+        ParkedTxn parked = _pool->acquire();
+        _txn = parked.txn;
+        _cursors = std::move(parked.cursors);
+        pool.env().reader_ages().begin(_txn);
+    }
+
+    ~ReadTxn() { _release(); }
+
+    ReadTxn(ReadTxn&& o) = default;
+    ReadTxn& operator=(ReadTxn&& o)
+    {
+        if (this != &o)
+        {
+            _release();
+            ReadOnlyTxn::operator=(std::move(o));
+            _pool = o._pool;
+        }
+        return *this;
+    }
+
+private:
+    void _release()
+    {
+        if (_txn != nullptr)
+        {
+            _pool->env().reader_ages().end(_txn);
+            _pool->release({_txn, std::move(_cursors)});
+            _txn = nullptr;
+        }
+    }
+
+    ReadTxnPool* _pool;
+};
+
+}  // namespace lmdbpp
+
+#endif
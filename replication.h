@@ -0,0 +1,290 @@
+#ifndef __lmdbpp_replication_h
+#define __lmdbpp_replication_h
+
+#include <lmdb.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include "lmdbpp.h"
+#include "changelog.h"
+
+namespace lmdbpp
+{
+
+// Tails a change log: every poll() reads the changes committed after
+// position() in one read-only transaction, in sequence order.
+class ChangeReader
+{
+public:
+    ChangeReader(Env& env, Dbi log, uint64_t after = 0)
+        : _env(env)
+        , _log(log)
+        , _position(after)
+    {
+    }
+
+    // Calls fn(const Change&) for up to max changes, returns how many. With
+    // whole_txns, it goes on past max to the last change of the transaction
+    // it's in. The Change views into the map, copy what has to outlive fn.
+    // If fn throws, position() stays at the last change it returned from.
+    // Throws ChangeLogTrimmedError if changes after position() were trimmed.
+    template <typename F>
+    size_t poll(F&& fn, size_t max = std::numeric_limits<size_t>::max(), bool whole_txns = false)
+    {
+        size_t n = 0;
+        with_read_txn(_env, [&](Txn& txn)
+        {
+            uint64_t trimmed;
+            check(ChangeLog::trimmed(txn.mdb_txn(), _log, trimmed));
+            if (_position < trimmed)
+                throw ChangeLogTrimmedError{_position, trimmed};
+            Cursor c = Cursor::borrow(txn, _log);
+            char from[8];
+            ChangeLog::encode_seq(_position + 1, from);
+            KeyVal<const char, const char> kv{Val<const char>{std::string_view{from, sizeof(from)}}, {}};
+            uint64_t txnid = 0;
+            for (bool ok = c.try_seek_range(kv); ok; ok = c.try_next(kv))
+            {
+                std::optional<Change> change = ChangeLog::decode(kv.key.to_strview(), kv.val.to_strview());
+                if (!change)
+                    check(MDB_CORRUPTED);
+                if (n >= max && !(whole_txns && change->txnid == txnid))
+                    break;
+                fn(*change);
+                _position = change->seq;
+                txnid = change->txnid;
+                ++n;
+            }
+        });
+        return n;
+    }
+
+    // sequence number of the last change returned
+    uint64_t position() const { return _position; }
+    void seek(uint64_t after) { _position = after; }
+
+private:
+    Env& _env;
+    const Dbi _log;
+    uint64_t _position;
+};
+
+// Deletes the records up to and including sequence number upto, e.g. once
+// every follower is past them, and records how far the log is trimmed so
+// readers behind that fail instead of skipping what's gone. Returns how many
+// were deleted.
+inline size_t trim_change_log(Txn& txn, Dbi log, uint64_t upto)
+{
+    uint64_t trimmed;
+    check(ChangeLog::trimmed(txn.mdb_txn(), log, trimmed));
+    size_t n = 0;
+    {
+        Cursor c{txn, log};
+        char from[8];
+        ChangeLog::encode_seq(1, from);
+        KeyVal<const char, const char> kv{Val<const char>{std::string_view{from, sizeof(from)}}, {}};
+        // after del() the cursor already sits on the next record, MDB_NEXT returns it
+        for (bool ok = c.try_seek_range(kv); ok && kv.key.size() == 8; ok = c.try_next(kv))
+        {
+            uint64_t seq = ChangeLog::decode_seq(kv.key.data());
+            if (seq > upto)
+                break;
+            c.del();
+            trimmed = std::max(trimmed, seq);
+            ++n;
+        }
+    }
+    if (n > 0)
+    {
+        // only up to the last record deleted, readers past it missed nothing
+        char key[8], val[8];
+        ChangeLog::encode_seq(0, key);
+        ChangeLog::encode_seq(trimmed, val);
+        txn.overwrite(log, Val{std::string_view{key, sizeof(key)}}, Val{std::string_view{val, sizeof(val)}});
+    }
+    return n;
+}
+
+struct FollowerArgs
+{
+    size_t batch = 4096;                        // changes applied per write transaction, rounded up to whole leader transactions
+    std::chrono::milliseconds interval{0};      // polls the leader this often on a thread of its own, 0 for none
+    std::string name = "default";               // the position is kept under this key, one per leader
+    std::function<void(std::exception_ptr)> on_error{};    // errors of the background thread, it keeps polling
+};
+
+// Keeps a replica env in step with a leader's change log. Changes are
+// replayed in batches, each in one write transaction on the replica that
+// also stores the position reached (in the dbi "lmdbpp.follower"), so a
+// restarted follower resumes exactly where the last committed batch ended.
+// Batches end with a leader transaction, readers of the replica never see
+// part of one. A follower behind the trimmed part of the log throws
+// ChangeLogTrimmedError, the replica has to be seeded anew.
+//
+// Dbis are created on the replica with the leader's flags. Ones with custom
+// comparators have to be opened with them on the replica before the first
+// catch_up(). The replica needs room for the leader's dbis plus one.
+class Follower
+{
+public:
+    Follower(Env& leader, Dbi log, Env& replica, FollowerArgs args = FollowerArgs{})
+        : _leader(leader)
+        , _log(log)
+        , _replica(replica)
+        , _args(std::move(args))
+    {
+        _state = with_write_txn(_replica, [](Txn& txn) { return txn.open_dbi("lmdbpp.follower", DbiFlags::CREATE); });
+        if (_args.interval.count() > 0)
+            _thread = std::thread{[this] { _run(); }};
+    }
+
+    ~Follower()
+    {
+        {
+            std::lock_guard lock{_mutex};
+            _stop = true;
+        }
+        _cv.notify_one();
+        if (_thread.joinable())
+            _thread.join();
+    }
+
+    Follower(const Follower&) = delete;
+    Follower& operator=(const Follower&) = delete;
+
+    // applies FollowerArgs::batch changes, or up to the end of the leader
+    // transaction the last one belongs to, returns how many
+    size_t step()
+    {
+        std::lock_guard lock{_step_mutex};
+        try
+        {
+            return with_write_txn(_replica, [&](Txn& txn)
+            {
+                // handles opened in an attempt with_write_txn rolled back are gone
+                _dbis.clear();
+                ChangeReader reader{_leader, _log, _position(txn)};
+                size_t n = reader.poll([&](const Change& c) { _apply(txn, c); }, _args.batch, true);
+                if (n > 0)
+                {
+                    uint64_t pos = reader.position();
+                    txn.overwrite(_state, Val{_args.name}, Val{&pos});
+                }
+                return n;
+            });
+        }
+        catch (...)
+        {
+            // handles opened in an aborted transaction are gone
+            _dbis.clear();
+            throw;
+        }
+    }
+
+    // applies changes until there are none left, returns how many
+    size_t catch_up()
+    {
+        size_t total = 0;
+        for (size_t n; (n = step()) > 0;)
+            total += n;
+        return total;
+    }
+
+    // sequence number of the last change applied to the replica
+    uint64_t position()
+    {
+        return with_read_txn(_replica, [&](Txn& txn) { return _position(txn); });
+    }
+
+private:
+    uint64_t _position(Txn& txn)
+    {
+        std::optional<Val<const uint64_t>> v = txn.try_get<const char, uint64_t>(_state, Val{_args.name});
+        if (!v || v->size() != sizeof(uint64_t))
+            return 0;
+        uint64_t pos;
+        std::memcpy(&pos, v->data(), sizeof(pos));
+        return pos;
+    }
+
+    // Replays one change. Replaying what the replica already has (a put of a
+    // value that's there, a delete of what's gone) is not an error, so a
+    // replica seeded from a copy of the leader catches up from any position.
+    void _apply(Txn& txn, const Change& c)
+    {
+        Dbi dbi = _dbi(txn, c);
+        MDB_val key{c.key.size(), (void*)c.key.data()};
+        MDB_val val{c.val.size(), (void*)c.val.data()};
+        int rc = 0;
+        switch (c.op)
+        {
+            case ChangeOp::PUT:     rc = mdb_put(txn.mdb_txn(), dbi, &key, &val, 0); break;
+            case ChangeOp::DEL:     rc = mdb_del(txn.mdb_txn(), dbi, &key, nullptr); break;
+            case ChangeOp::DEL_DUP: rc = mdb_del(txn.mdb_txn(), dbi, &key, &val); break;
+            default:                check(MDB_CORRUPTED);
+        }
+        if (rc == MDB_KEYEXIST || rc == MDB_NOTFOUND)
+            return;
+        check(rc);
+        // the replica's own filters and change log see the write too
+        if (c.op == ChangeOp::PUT)
+            txn.note_put(dbi, &key, &val, 0);
+        else
+            txn.note_del(dbi, &key, c.op == ChangeOp::DEL_DUP ? &val : nullptr);
+    }
+
+    Dbi _dbi(Txn& txn, const Change& c)
+    {
+        std::string name{c.dbi};
+        auto it = _dbis.find(name);
+        if (it != _dbis.end())
+            return it->second;
+        DbiFlags flags = (DbiFlags)c.flags | DbiFlags::CREATE;
+        Dbi dbi = txn.open_dbi(name.empty() ? nullptr : name.c_str(), flags);
+        _dbis.emplace(std::move(name), dbi);
+        return dbi;
+    }
+
+    void _run()
+    {
+        std::unique_lock lock{_mutex};
+        while (!_cv.wait_for(lock, _args.interval, [this] { return _stop; }))
+        {
+            lock.unlock();
+            try { catch_up(); }
+            catch (...)
+            {
+                // tried again next round
+                if (_args.on_error)
+                    _args.on_error(std::current_exception());
+            }
+            lock.lock();
+        }
+    }
+
+    Env& _leader;
+    const Dbi _log;
+    Env& _replica;
+    const FollowerArgs _args;
+    Dbi _state;
+    std::mutex _step_mutex;
+    std::map<std::string, Dbi> _dbis;   // replica dbis by name
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    bool _stop = false;
+    std::thread _thread;
+};
+
+}  // namespace lmdbpp
+
+#endif
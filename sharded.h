@@ -0,0 +1,455 @@
+#ifndef __lmdbpp_sharded_h
+#define __lmdbpp_sharded_h
+
+#include <lmdb.h>
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "lmdbpp.h"
+#include "iterators.h"
+#include "writer.h"
+
+namespace lmdbpp
+{
+
+// maps a key to one of `shards` shards. Shards persist what was routed to
+// them, so a partitioner must give the same answer across processes and builds.
+typedef std::function<size_t(std::string_view key, size_t shards)> Partitioner;
+
+// FNV-1a, unlike std::hash stable across standard libraries
+struct HashPartitioner
+{
+    size_t operator()(std::string_view key, size_t shards) const
+    {
+        uint64_t h = 14695981039346656037ull;
+        for (char c : key)
+            h = (h ^ (unsigned char)c) * 1099511628211ull;
+        return h % shards;
+    }
+};
+
+// shard i holds the keys in [splits[i-1], splits[i]), in memcmp order, so
+// there have to be shards - 1 sorted splits
+struct RangePartitioner
+{
+    std::vector<std::string> splits;
+
+    size_t operator()(std::string_view key, size_t shards) const
+    {
+        size_t shard = std::upper_bound(splits.begin(), splits.end(), key) - splits.begin();
+        return std::min(shard, shards - 1);
+    }
+};
+
+struct ShardedEnvArgs
+{
+    EnvArgs env{};                  // for every shard
+    GroupCommitArgs writer{};       // for every shard's writer
+    Partitioner partitioner = HashPartitioner{};
+};
+
+// one dbi, opened in every shard
+struct ShardedDbi
+{
+    std::vector<Dbi> dbis;
+
+    Dbi operator[](size_t shard) const { return dbis[shard]; }
+};
+
+// The batch failed to commit on some shards after others committed theirs,
+// see ShardedBatch::commit()
+class PartialCommitError : public std::runtime_error
+{
+public:
+    PartialCommitError(std::vector<size_t> committed, std::vector<std::pair<size_t, std::exception_ptr>> failed)
+        : runtime_error{"lmdbpp: batch committed on some shards only"}
+        , committed(std::move(committed))
+        , failed(std::move(failed))
+    {
+    }
+
+    std::vector<size_t> committed;
+    std::vector<std::pair<size_t, std::exception_ptr>> failed;     // shard, what its commit threw
+};
+
+// Key ordered view over [lo, hi) of a ShardedDbi across all shards: a k-way
+// merge over one KeyRange per shard, each in its own read-only transaction.
+// Keys are compared with the first shard's comparator, which all shards have
+// to share. Values point into the shards' maps and stay valid as long as the
+// range does.
+class MergedRange
+{
+public:
+    typedef KeyVal<const char, const char> value_type;
+    typedef std::optional<std::string> Bound;
+
+    class iterator
+    {
+    public:
+        typedef MergedRange::value_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::input_iterator_tag iterator_concept;
+
+        iterator() = default;
+        iterator(MergedRange* range) : _range(range) {}
+
+        const value_type& operator*() const { return _range->_kv; }
+        const value_type* operator->() const { return &_range->_kv; }
+
+        iterator& operator++()
+        {
+            _range->_advance();
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+
+        friend bool operator==(const iterator& it, std::default_sentinel_t) { return it._at_end(); }
+
+    private:
+        bool _at_end() const { return _range == nullptr || _range->_end; }
+
+        MergedRange* _range = nullptr;
+    };
+
+    MergedRange(const std::vector<std::unique_ptr<Env>>& shards, const ShardedDbi& dbi, Bound lo, Bound hi, iterators::Order order = iterators::Order::FORWARD)
+        : _dbi(dbi)
+        , _lo(std::move(lo))
+        , _hi(std::move(hi))
+        , _order(order)
+    {
+        // the ranges refer to the transactions, neither may move once created
+        _txns.reserve(shards.size());
+        _ranges.reserve(shards.size());
+        for (size_t i = 0; i < shards.size(); ++i)
+        {
+            _txns.emplace_back(*shards[i]);
+            _ranges.emplace_back(_txns[i], dbi[i], _view(_lo), _view(_hi), order);
+        }
+    }
+
+    MergedRange(const MergedRange&) = delete;
+    MergedRange& operator=(const MergedRange&) = delete;
+
+    iterator begin()
+    {
+        _start();
+        return iterator{this};
+    }
+    std::default_sentinel_t end() { return {}; }
+
+    // shard the current entry came from
+    size_t shard() const { return _shard; }
+
+private:
+    typedef iterators::KeyRange<char, char> Range;
+
+    static std::optional<Val<const char>> _view(const Bound& b)
+    {
+        if (!b)
+            return std::nullopt;
+        return Val<const char>{*b};
+    }
+
+    // heap order: true if shard a's next entry comes after shard b's
+    bool _after(size_t a, size_t b)
+    {
+        int cmp = _txns[0].compare(_dbi[0], _its[a]->key, _its[b]->key);
+        if (_order == iterators::Order::REVERSE)
+            cmp = -cmp;
+        return cmp != 0 ? cmp > 0 : a > b;
+    }
+
+    void _start()
+    {
+        _its.clear();
+        _heap.clear();
+        for (size_t i = 0; i < _ranges.size(); ++i)
+        {
+            _its.push_back(_ranges[i].begin());
+            if (!(_its[i] == std::default_sentinel))
+                _heap.push_back(i);
+        }
+        std::make_heap(_heap.begin(), _heap.end(), [this](size_t a, size_t b) { return _after(a, b); });
+        _advance();
+    }
+
+    // takes the next entry from the shard on top of the heap and moves that shard's range on
+    void _advance()
+    {
+        auto after = [this](size_t a, size_t b) { return _after(a, b); };
+        _end = _heap.empty();
+        if (_end)
+            return;
+        std::pop_heap(_heap.begin(), _heap.end(), after);
+        _shard = _heap.back();
+        _kv = *_its[_shard];
+        ++_its[_shard];
+        if (_its[_shard] == std::default_sentinel)
+            _heap.pop_back();
+        else
+            std::push_heap(_heap.begin(), _heap.end(), after);
+    }
+
+    ShardedDbi _dbi;
+    Bound _lo;
+    Bound _hi;
+    iterators::Order _order;
+    std::vector<ReadOnlyTxn> _txns;
+    std::vector<Range> _ranges;
+    std::vector<Range::iterator> _its;
+    std::vector<size_t> _heap;
+    value_type _kv;
+    size_t _shard = 0;
+    bool _end = true;
+};
+
+class ShardedEnv;
+
+// Writes to any number of shards, applied together by commit()
+class ShardedBatch
+{
+public:
+    ShardedBatch(ShardedEnv& env);
+
+    void put(const ShardedDbi& dbi, std::string_view key, std::string_view val) { _add(Op::PUT, dbi, key, val); }
+    void overwrite(const ShardedDbi& dbi, std::string_view key, std::string_view val) { _add(Op::OVERWRITE, dbi, key, val); }
+    void del(const ShardedDbi& dbi, std::string_view key) { _add(Op::DEL, dbi, key, {}); }
+
+    // Best-effort atomic commit, a write transaction per shard the batch
+    // touches, each on its own thread so the shards fsync in parallel.
+    //
+    // The ops are applied to every transaction first: if any of them fails
+    // all are aborted and its error is rethrown, nothing was written. Only
+    // then are they committed. A commit that fails after others succeeded
+    // (a full disk, an I/O error) can't be undone and throws
+    // PartialCommitError, saying which shards did commit.
+    void commit();
+
+    bool empty() const { return _shards.empty(); }
+
+private:
+    struct Op
+    {
+        enum Kind { PUT, OVERWRITE, DEL };
+        Kind kind;
+        Dbi dbi;
+        std::string key;
+        std::string val;
+    };
+
+    void _add(Op::Kind kind, const ShardedDbi& dbi, std::string_view key, std::string_view val);
+    static void _apply(Txn& txn, std::vector<Op>& ops);
+
+    ShardedEnv& _env;
+    std::vector<std::pair<size_t, std::vector<Op>>> _shards;    // in shard order
+};
+
+// Spreads one keyspace over several environments, each with its own
+// GroupCommitWriter, so writes scale with the number of shards instead of
+// being bound to one writer and one fsync stream. Put shards on different
+// disks to spread the I/O as well.
+class ShardedEnv
+{
+public:
+    ShardedEnv(const std::vector<std::string>& paths, ShardedEnvArgs args = ShardedEnvArgs{})
+        : _partitioner(std::move(args.partitioner))
+    {
+        // partitioners map keys onto [0, shards)
+        if (paths.empty())
+            check(EINVAL);
+        for (const std::string& path : paths)
+            _shards.push_back(std::make_unique<Env>(path, args.env));
+        for (auto& shard : _shards)
+            _writers.push_back(std::make_unique<GroupCommitWriter>(*shard, args.writer));
+    }
+
+    ShardedEnv(const ShardedEnv&) = delete;
+    ShardedEnv& operator=(const ShardedEnv&) = delete;
+
+    size_t size() const { return _shards.size(); }
+    Env& shard(size_t i) { return *_shards[i]; }
+    GroupCommitWriter& writer(size_t i) { return *_writers[i]; }
+    size_t shard_of(std::string_view key) const { return _partitioner(key, _shards.size()); }
+
+    ShardedDbi open_dbi(const char* name = nullptr, DbiFlags flags = DbiFlags::NONE)
+    {
+        ShardedDbi dbi;
+        for (auto& shard : _shards)
+        {
+            Txn txn{*shard};
+            dbi.dbis.push_back(txn.open_dbi(name, flags));
+        }
+        return dbi;
+    }
+
+    // single key writes go through the shard's writer, see GroupCommitWriter
+    std::future<void> put(const ShardedDbi& dbi, std::string_view key, std::string_view val) { size_t s = shard_of(key); return _writers[s]->put(dbi[s], key, val); }
+    std::future<void> overwrite(const ShardedDbi& dbi, std::string_view key, std::string_view val) { size_t s = shard_of(key); return _writers[s]->overwrite(dbi[s], key, val); }
+    std::future<void> del(const ShardedDbi& dbi, std::string_view key) { size_t s = shard_of(key); return _writers[s]->del(dbi[s], key); }
+
+    // waits until everything queued on any writer so far is committed
+    void flush()
+    {
+        std::vector<std::future<void>> done;
+        for (auto& w : _writers)
+            done.push_back(w->flush());
+        for (auto& d : done)
+            d.get();
+    }
+
+    std::optional<std::string> get(const ShardedDbi& dbi, std::string_view key)
+    {
+        size_t s = shard_of(key);
+        ReadOnlyTxn txn{*_shards[s]};
+        auto val = txn.try_get<const char, char>(dbi[s], Val<const char>{key});
+        if (!val)
+            return std::nullopt;
+        return val->to_str();
+    }
+
+    // unbounded sides are std::nullopt
+    MergedRange scan(const ShardedDbi& dbi, MergedRange::Bound lo = std::nullopt, MergedRange::Bound hi = std::nullopt, iterators::Order order = iterators::Order::FORWARD)
+    {
+        return MergedRange{_shards, dbi, std::move(lo), std::move(hi), order};
+    }
+
+    ShardedBatch batch() { return ShardedBatch{*this}; }
+
+private:
+    const Partitioner _partitioner;
+    std::vector<std::unique_ptr<Env>> _shards;
+    std::vector<std::unique_ptr<GroupCommitWriter>> _writers;
+};
+
+inline ShardedBatch::ShardedBatch(ShardedEnv& env) : _env(env) {}
+
+inline void ShardedBatch::_add(Op::Kind kind, const ShardedDbi& dbi, std::string_view key, std::string_view val)
+{
+    size_t s = _env.shard_of(key);
+    auto it = std::lower_bound(_shards.begin(), _shards.end(), s, [](const auto& shard, size_t s) { return shard.first < s; });
+    if (it == _shards.end() || it->first != s)
+        it = _shards.insert(it, {s, {}});
+    it->second.push_back(Op{kind, dbi[s], std::string{key}, std::string{val}});
+}
+
+inline void ShardedBatch::_apply(Txn& txn, std::vector<Op>& ops)
+{
+    for (Op& op : ops)
+    {
+        Val<const char> key{op.key}, val{op.val};
+        switch (op.kind)
+        {
+            case Op::PUT:       txn.put(op.dbi, key, val); break;
+            case Op::OVERWRITE: txn.overwrite(op.dbi, key, val); break;
+            case Op::DEL:       txn.del(op.dbi, key); break;
+        }
+    }
+}
+
+inline void ShardedBatch::commit()
+{
+    size_t n = _shards.size();
+    std::vector<std::exception_ptr> apply_errors(n), commit_errors(n);
+    std::atomic<bool> failed{false};
+    std::barrier applied{(std::ptrdiff_t)n};
+
+    // write transactions belong to the thread that began them, so each
+    // shard's is applied, then committed or aborted, on one thread
+    auto run = [&](size_t i)
+    {
+        Env& env = _env.shard(_shards[i].first);
+        std::optional<WriteTxn> txn;
+        auto discard = [&]
+        {
+            if (txn)
+                txn->abort();
+            txn.reset();
+        };
+        // a full map is grown and the shard's part applied again, as in with_write_txn()
+        for (bool retry = true; retry;)
+        {
+            retry = false;
+            try
+            {
+                txn.emplace(env);
+                _apply(*txn, _shards[i].second);
+            }
+            catch (MapFullError&)
+            {
+                discard();
+                retry = env.grow();
+                if (!retry)
+                    apply_errors[i] = std::current_exception();
+            }
+            catch (MapResizedError&)
+            {
+                discard();
+                retry = env.adopt_mapsize();
+                if (!retry)
+                    apply_errors[i] = std::current_exception();
+            }
+            catch (...)
+            {
+                discard();
+                apply_errors[i] = std::current_exception();
+            }
+        }
+        if (apply_errors[i])
+            failed = true;
+        applied.arrive_and_wait();
+        if (!txn)
+            return;
+        if (failed)
+        {
+            txn->abort();
+            return;
+        }
+        try { txn->commit(); }
+        catch (...) { commit_errors[i] = std::current_exception(); }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < n; ++i)
+        threads.emplace_back(run, i);
+    if (n > 0)
+        run(0);
+    for (auto& t : threads)
+        t.join();
+
+    auto shards = std::move(_shards);
+    _shards.clear();
+    for (auto& e : apply_errors)
+    {
+        if (e)
+            std::rethrow_exception(e);
+    }
+    std::vector<size_t> committed;
+    std::vector<std::pair<size_t, std::exception_ptr>> commit_failed;
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (commit_errors[i])
+            commit_failed.emplace_back(shards[i].first, commit_errors[i]);
+        else
+            committed.push_back(shards[i].first);
+    }
+    if (commit_failed.empty())
+        return;
+    if (committed.empty())
+        std::rethrow_exception(commit_failed[0].second);
+    throw PartialCommitError{std::move(committed), std::move(commit_failed)};
+}
+
+}  // namespace lmdbpp
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef __lmdbpp_stat_h
+#define __lmdbpp_stat_h
+
+#include <lmdb.h>
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+#include "lmdbpp.h"
+
+namespace lmdbpp
+{
+
+struct AnalyzeArgs
+{
+    size_t sample_entries = 1000;   // entries read from each end of a dbi to estimate fill factors
+    // Also analyze the dbis named in the main dbi (needs maxdbs). Finding
+    // them walks every key of the main dbi, a full scan if data is kept there.
+    bool named_dbis = false;
+};
+
+struct DbiStats
+{
+    std::string name;               // empty for the main dbi
+    DbiFlags flags = DbiFlags::NONE;
+    unsigned int depth = 0;
+    size_t entries = 0;
+    size_t branch_pages = 0;
+    size_t leaf_pages = 0;
+    size_t overflow_pages = 0;
+    size_t sampled = 0;             // entries the fill estimates are based on
+    double avg_key_size = 0;
+    double avg_val_size = 0;
+    double leaf_fill = 0;           // estimated fraction of leaf/branch page space in use
+    double branch_fill = 0;
+
+    size_t pages() const { return branch_pages + leaf_pages + overflow_pages; }
+};
+
+struct EnvStats
+{
+    unsigned int page_size = 0;
+    size_t map_size = 0;
+    size_t map_pages = 0;
+    size_t used_pages = 0;          // high water mark, pages up to last_pgno
+    size_t last_txnid = 0;
+    unsigned int max_readers = 0;
+    unsigned int num_readers = 0;
+    size_t oldest_reader_txnid = 0; // 0 without active readers
+    size_t free_pages = 0;          // pages on the freelist
+    size_t reusable_free_pages = 0; // of those, freed before the oldest reader's snapshot
+    size_t freelist_entries = 0;    // transactions that freed the pages above
+    DbiStats main;
+    std::vector<DbiStats> dbis;
+
+    // txns the oldest reader lags behind, it pins every page freed since
+    size_t reader_lag() const { return oldest_reader_txnid ? last_txnid - oldest_reader_txnid : 0; }
+    double map_used() const { return map_pages ? (double)used_pages / map_pages : 0; }
+};
+
+namespace detail
+{
+// size of LMDB's private MDB_db, the value of a named dbi's key in the main
+// dbi: md_pad, md_flags, md_depth, three page counts, md_entries, md_root
+constexpr size_t db_record_size = 4 + 2 + 2 + 5 * sizeof(size_t);
+
+// Estimates fill factors from the average entry size of up to 2*sample
+// entries from both ends of the dbi, node and page overheads as in LMDB
+inline void estimate_fill(Txn& txn, Dbi dbi, DbiStats& s, unsigned int psize, size_t sample)
+{
+    const double page_header = 16, node_header = 8, index = 2;
+    const size_t overflow_threshold = (psize - 16) / 2;
+    double key_bytes = 0, val_bytes = 0, node_bytes = 0;
+
+    Cursor c = Cursor::borrow(txn, dbi);
+    KeyVal<const char, const char> kv;
+    auto add = [&]
+    {
+        ++s.sampled;
+        key_bytes += kv.key.size();
+        val_bytes += kv.val.size();
+        size_t node = kv.key.size() + kv.val.size();
+        // big values live on overflow pages, the node only holds their page number
+        node_bytes += node_header + index + (node >= overflow_threshold ? kv.key.size() + sizeof(size_t) : node);
+    };
+    size_t front = 0;
+    for (bool ok = c.try_first(kv); ok && front < sample; ok = c.try_next(kv), ++front)
+        add();
+    if (s.entries > front)
+        for (bool ok = c.try_last(kv); ok && s.sampled < front + std::min(sample, s.entries - front); ok = c.try_prev(kv))
+            add();
+    if (s.sampled == 0)
+        return;
+
+    s.avg_key_size = key_bytes / s.sampled;
+    s.avg_val_size = val_bytes / s.sampled;
+    double usable = psize - page_header;
+    if (s.leaf_pages > 0)
+        s.leaf_fill = std::min(1.0, s.entries * (node_bytes / s.sampled) / (s.leaf_pages * usable));
+    // every page below a branch page has a node (key + page number) on it
+    if (s.branch_pages > 0)
+        s.branch_fill = std::min(1.0, (s.leaf_pages + s.branch_pages - 1) * (node_header + index + s.avg_key_size) / (s.branch_pages * usable));
+}
+
+inline DbiStats dbi_stats(Txn& txn, Dbi dbi, std::string name, unsigned int psize, size_t sample)
+{
+    MDB_stat st = txn.stat(dbi);
+    DbiStats s;
+    s.name = std::move(name);
+    s.flags = txn.dbi_flags(dbi);
+    s.depth = st.ms_depth;
+    s.entries = st.ms_entries;
+    s.branch_pages = st.ms_branch_pages;
+    s.leaf_pages = st.ms_leaf_pages;
+    s.overflow_pages = st.ms_overflow_pages;
+    estimate_fill(txn, dbi, s, psize, sample);
+    return s;
+}
+}  // namespace detail
+
+// Collects page level statistics of an environment from mdb_env_info,
+// mdb_stat and the freelist, without scanning the data: per dbi only
+// args.sample_entries from each end are read to estimate fill factors.
+// The exception is AnalyzeArgs::named_dbis, off by default.
+inline EnvStats analyze(Env& env, AnalyzeArgs args = AnalyzeArgs{})
+{
+    EnvStats s;
+    MDB_envinfo info = env.info();
+    s.page_size = env.stat().ms_psize;
+    s.map_size = info.me_mapsize;
+    s.map_pages = info.me_mapsize / s.page_size;
+    s.used_pages = info.me_last_pgno + 1;
+    s.max_readers = info.me_maxreaders;
+    s.num_readers = info.me_numreaders;
+
+    Txn txn{env, MDB_RDONLY};
+    s.last_txnid = mdb_txn_id(txn.mdb_txn());
+    for (const ReaderInfo& r : env.readers())
+    {
+        // our own reader doesn't count
+        if (r.txnid != 0 && r.txnid != s.last_txnid)
+            s.oldest_reader_txnid = s.oldest_reader_txnid ? std::min(s.oldest_reader_txnid, r.txnid) : r.txnid;
+    }
+
+    // the freelist is dbi 0: txnid -> [count, pgno...] of the pages it freed
+    {
+        Cursor c{txn, 0};
+        KeyVal<const size_t, const size_t> kv;
+        for (bool ok = c.try_first(kv); ok; ok = c.try_next(kv))
+        {
+            size_t count = kv.val.data()[0];
+            ++s.freelist_entries;
+            s.free_pages += count;
+            if (s.oldest_reader_txnid == 0 || *kv.key.data() < s.oldest_reader_txnid)
+                s.reusable_free_pages += count;
+        }
+    }
+
+    Dbi main = txn.open_dbi();
+    s.main = detail::dbi_stats(txn, main, "", s.page_size, args.sample_entries);
+    if (!args.named_dbis)
+        return s;
+
+    // Keys of the main dbi that open as a dbi name the named dbis. Their
+    // values are LMDB's MDB_db records, other sizes aren't worth a try.
+    std::vector<std::string> names;
+    {
+        Cursor c{txn, main};
+        KeyVal<const char, const char> kv;
+        for (bool ok = c.try_first(kv); ok; ok = c.try_next_nodup(kv))
+            if (kv.val.size() == detail::db_record_size)
+                names.emplace_back(kv.key.data(), kv.key.size());
+    }
+    for (const std::string& name : names)
+    {
+        if (name.find('\0') != std::string::npos)
+            continue;
+        Dbi dbi;
+        int rc = mdb_dbi_open(txn.mdb_txn(), name.c_str(), 0, &dbi);
+        if (rc == MDB_INCOMPATIBLE || rc == MDB_NOTFOUND)
+            continue;      // a plain key
+        if (rc == MDB_DBS_FULL)
+            break;
+        check(rc);
+        s.dbis.push_back(detail::dbi_stats(txn, dbi, name, s.page_size, args.sample_entries));
+    }
+    return s;
+}
+
+}  // namespace lmdbpp
+
+#endif
@@ -3,7 +3,26 @@
 #include <filesystem>
 #include "lmdbpp.h"
 #include "iterators.h"
+#include "writer.h"
+#include "parallel.h"
+#include "bulk.h"
+#include "codec.h"
+#include "aggregate.h"
+#include "stat.h"
+#include "backup.h"
+#include "watchdog.h"
+#include "async.h"
+#include "sharded.h"
+#include "filter.h"
+#include "cache.h"
+#include "replication.h"
+#include "index.h"
 #include <iostream>
+#include <algorithm>
+#include <ranges>
+#include <numeric>
+#include <set>
+#include <random>
 #include <assert.h>
 
 using namespace lmdbpp;
@@ -54,7 +73,7 @@ void multi(Env& env)
 
     MultiValIterator<decltype(key)::t, int> it1{txn,dbi,key};
     for (auto& vals : it1)
-        assert(vals.size() == n*sizeof(int));
+        assert(vals.size() == n && vals[n-1] == n-1);
     DupValIterator<decltype(key)::t, int> it2{txn,dbi,key};
     for (auto& vals : it2)
         assert(vals.size() == sizeof(int));
@@ -105,6 +124,1093 @@ void abort(Env& env)
     }
 }
 
+void try_api(Env& env)
+{
+    Txn txn{env};
+    Dbi dbi = txn.open_dbi();
+    Cursor c{txn, dbi};
+    assert((!c.try_first<char, char>()));
+    assert(!c.try_seek(Val{"nope"}));
+    assert((!txn.try_get<const char, char>(dbi, Val{"nope"})));
+
+    c.put(Val{"test"}, Val{"hello"});
+    auto v = txn.try_get<const char, char>(dbi, Val{"test"});
+    assert(v && v->to_str() == "hello");
+
+    auto kv = c.try_first<char, char>();
+    assert(kv && kv->key.to_str() == "test");
+    assert((!c.try_next<char, char>()));
+}
+
+void pooled_read(Env& env)
+{
+    Dbi dbi;
+    {
+        Txn txn{env};
+        dbi = txn.open_dbi();
+        txn.put(dbi, Val{"key"}, Val{"val"});
+    }
+    ReadTxnPool pool{env};
+    MDB_txn* first = nullptr;
+    for (int i=0; i<3; ++i)
+    {
+        ReadTxn txn{pool};
+        if (first == nullptr)
+            first = txn.mdb_txn();
+        assert(txn.mdb_txn() == first);
+        auto val = txn.get<const char, char>(dbi, Val{"key"});
+        assert(val.to_str() == "val");
+    }
+}
+
+void cursor_cache(Env& env)
+{
+    Dbi dbi;
+    {
+        Txn txn{env};
+        dbi = txn.open_dbi();
+        txn.put(dbi, Val{"key"}, Val{"val"});
+    }
+    // a cursor outliving its txn isn't cached in it: a write txn's is gone
+    // with it, a read-only one's is closed
+    for (unsigned int flags : {0u, (unsigned int)MDB_RDONLY})
+    {
+        Txn txn{env, flags};
+        Cursor c = Cursor::borrow(txn, dbi);
+        txn.commit();
+    }
+
+    ReadTxnPool pool{env};
+    MDB_cursor* first = nullptr;
+    for (int i=0; i<3; ++i)
+    {
+        ReadTxn txn{pool};
+        Cursor c = Cursor::borrow(txn, dbi);
+        if (first == nullptr)
+            first = c.mdb_cursor();
+        assert(c.mdb_cursor() == first);
+        auto kv = c.first<char, char>();
+        assert(kv.key.to_str() == "key");
+    }
+}
+
+void group_commit(Env& env)
+{
+    Dbi dbi;
+    {
+        Txn txn{env};
+        dbi = txn.open_dbi();
+    }
+    {
+        GroupCommitWriter writer{env};
+        std::vector<std::thread> threads;
+        for (int t=0; t<4; ++t)
+        {
+            threads.emplace_back([&writer, dbi, t]
+            {
+                std::vector<std::future<void>> done;
+                for (int i=0; i<100; ++i)
+                    done.push_back(writer.put(dbi, std::to_string(t * 1000 + i), "v"));
+                for (auto& f : done)
+                    f.get();
+            });
+        }
+        for (auto& t : threads)
+            t.join();
+
+        auto dup = writer.put(dbi, "0", "again");
+        try
+        {
+            dup.get();
+            assert(0);
+        }
+        catch(KeyExistsError& e)
+        { }
+        writer.flush().get();
+        auto stats = writer.stats();
+        assert(stats.ops == 401 && stats.failed_ops == 1);
+        // concurrent writers share commits
+        assert(stats.batches < stats.ops);
+
+        // a flush with nothing before it commits nothing
+        writer.flush().get();
+        assert(writer.stats().batches == stats.batches && writer.stats().fsyncs == stats.fsyncs);
+
+        // a key too big for LMDB only fails its own op, not its batch
+        auto ok = writer.put(dbi, "ok", "v");
+        auto bad = writer.put(dbi, std::string(1000, 'k'), "v");
+        ok.get();
+        try
+        {
+            bad.get();
+            assert(0);
+        }
+        catch(BadValsizeError& e)
+        { }
+    }
+    Txn txn{env};
+    int n = 0;
+    KeyValIterator<char, char> it{txn, dbi};
+    for (auto& kv : it)
+        ++n;
+    assert(n == 401);
+}
+
+void reserve(Env& env)
+{
+    Txn txn{env};
+    Dbi dbi = txn.open_dbi();
+    std::string val(1000, 'x');
+    auto span = txn.reserve(dbi, Val{"big"}, val.size());
+    assert(span.size() == val.size());
+    std::memcpy(span.data(), val.data(), val.size());
+
+    Cursor c{txn, dbi};
+    c.reserve(Val{"small"}, 5, [](std::span<char> out) { std::memcpy(out.data(), "hello", 5); });
+
+    assert((txn.get<const char, char>(dbi, Val{"big"}).to_str() == val));
+    assert((txn.get<const char, char>(dbi, Val{"small"}).to_str() == "hello"));
+}
+
+template <typename TRange>
+std::vector<std::string> keys(TRange&& range)
+{
+    std::vector<std::string> out;
+    for (auto& kv : range)
+        out.push_back(kv.key.to_str());
+    return out;
+}
+
+void ranges(Env& env)
+{
+    Txn txn{env};
+    Dbi dbi = txn.open_dbi();
+    for (auto k : {"a", "ab", "abc", "b", "c"})
+        txn.put(dbi, Val{k}, Val{"v"});
+
+    typedef KeyRange<char, char> Range;
+    typedef std::vector<std::string> Keys;
+    assert((keys(Range{txn, dbi, Val{"ab"}, Val{"c"}}) == Keys{"ab", "abc", "b"}));
+    assert((keys(Range{txn, dbi, Val{"ab"}, Val{"c"}, Order::REVERSE}) == Keys{"b", "abc", "ab"}));
+    assert((keys(Range{txn, dbi, std::nullopt, Val{"b"}, Order::REVERSE}) == Keys{"abc", "ab", "a"}));
+    assert((keys(Range::prefix(txn, dbi, Val{"ab"})) == Keys{"ab", "abc"}));
+    assert((keys(Range::prefix(txn, dbi, Val{"ab"}, Order::REVERSE)) == Keys{"abc", "ab"}));
+    assert((keys(Range::all(txn, dbi, Order::REVERSE)).size() == 5));
+
+    auto all = Range::all(txn, dbi);
+    assert(std::ranges::count_if(all, [](auto& kv) { return kv.key.size() > 1; }) == 2);
+}
+
+void parallel(Env& env)
+{
+    const int n = 2000;
+    Dbi dbi;
+    {
+        Txn txn{env};
+        dbi = txn.open_dbi();
+        for (int i=0; i<n; ++i)
+        {
+            unsigned char key[4] = {(unsigned char)(i >> 24), (unsigned char)(i >> 16), (unsigned char)(i >> 8), (unsigned char)i};
+            txn.put(dbi, Val<unsigned char>{key, sizeof(key)}, Val{&i});
+        }
+    }
+    ParallelScanArgs args{.threads=4, .min_entries_per_partition=100};
+
+    std::atomic<int> count{0};
+    parallel_scan<unsigned char, int>(env, dbi, [&](size_t, auto&) { ++count; }, args);
+    assert(count == n);
+
+    long sum = parallel_reduce<unsigned char, int>(env, dbi, 0L,
+        [](long& acc, auto& kv) { acc += *kv.val.data(); },
+        [](long& acc, long other) { acc += other; }, args);
+    assert(sum == (long)n * (n - 1) / 2);
+
+    // no threads asked for still makes one partition
+    args.threads = 0;
+    long entries = parallel_reduce<unsigned char, int>(env, dbi, 0L,
+        [](long& acc, auto&) { ++acc; },
+        [](long& acc, long other) { acc += other; }, args);
+    assert(entries == n);
+}
+
+void get_many(Env& env)
+{
+    Txn txn{env};
+    Dbi dbi = txn.open_dbi();
+    for (auto k : {"b", "d", "f"})
+        txn.put(dbi, Val{k}, Val{k});
+
+    std::vector<Val<const char>> keys;
+    for (auto k : {"f", "a", "d", "d", "z", "b", "c"})
+        keys.emplace_back(k);
+    std::vector<Val<const char>> vals(keys.size());
+    assert((txn.get_many<const char, char>(dbi, keys, vals) == 4));
+    for (size_t i=0; i<keys.size(); ++i)
+    {
+        if (vals[i].data() != nullptr)
+            assert(vals[i].to_str() == keys[i].to_str());
+        else
+            assert(keys[i].to_str() == "a" || keys[i].to_str() == "z" || keys[i].to_str() == "c");
+    }
+
+    vals.pop_back();
+    try { txn.get_many<const char, char>(dbi, keys, vals); assert(false); }
+    catch (Error&) {}
+}
+
+void bulk_load(Env& env)
+{
+    Dbi dbi;
+    {
+        Txn txn{env};
+        dbi = txn.open_dbi();
+    }
+    std::vector<int> order(500);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), std::mt19937{42});
+
+    BulkLoader loader{env, dbi, {.run_bytes=1024, .commit_bytes=2048, .threads=2}};
+    for (int i : order)
+    {
+        unsigned char key[4] = {(unsigned char)(i >> 24), (unsigned char)(i >> 16), (unsigned char)(i >> 8), (unsigned char)i};
+        loader.add(Val<unsigned char>{key, sizeof(key)}, Val{&i});
+    }
+    auto stats = loader.finish();
+    assert(stats.records == 500 && stats.appended == 500 && stats.runs > 1 && stats.commits > 1);
+
+    Txn txn{env};
+    int expect = 0;
+    KeyValIterator<unsigned char, int> it{txn, dbi};
+    for (auto& kv : it)
+        assert(*kv.val.data() == expect++);
+    assert(expect == 500);
+    txn.abort();
+
+    // repeated keys across many runs: the first one added is kept, or with
+    // overwrite the last one
+    const char* keys[] = {"r0", "r1", "r2"};
+    for (bool overwrite : {false, true})
+    {
+        BulkLoader repeated{env, dbi, {.run_bytes=64, .threads=2, .overwrite=overwrite}};
+        for (int i=0; i<300; ++i)
+        {
+            int v = overwrite ? 1000 + i : i;
+            repeated.add(Val{keys[i % 3]}, Val{&v});
+        }
+        auto s = repeated.finish();
+        assert(s.records == 300 && s.runs > 1);
+
+        Txn ro{env, MDB_RDONLY};
+        for (int i=0; i<3; ++i)
+            assert((*ro.try_get<const char, int>(dbi, Val{keys[i]})->data() == (overwrite ? 1297 + i : i)));
+    }
+}
+
+void bulk_load_dupfixed(Env& env)
+{
+    Dbi dbi;
+    {
+        Txn txn{env};
+        dbi = txn.open_dbi(nullptr, DbiFlags::DUPSORT | DbiFlags::DUPFIXED);
+    }
+    BulkLoader loader{env, dbi};
+    for (int v=19; v>=0; --v)
+        for (auto k : {"b", "a", "c"})
+            loader.add(Val{k}, Val{&v});
+    auto stats = loader.finish();
+    assert(stats.records == 60 && stats.multiple == 60);
+
+    // overwrite replaces a key's duplicates, MDB_MULTIPLE or not
+    BulkLoader replace{env, dbi, {.overwrite=true}};
+    for (int v : {100, 101})
+        replace.add(Val{"b"}, Val{&v});
+    stats = replace.finish();
+    assert(stats.multiple == 2);
+
+    Txn txn{env};
+    Cursor c{txn, dbi};
+    c.seek(Val{"b"});
+    assert(c.dup_count() == 2);
+    c.seek(Val{"a"});
+    assert(c.dup_count() == 20);
+}
+
+void map_growth(Env& fixed)
+{
+    std::string path{"test.mdb/grow"};
+    std::filesystem::create_directory(path);
+    Env env{path, {.flags=EnvArgs::Flags::CREATE, .mapsize=64*1024, .growth={.max=64*1024*1024, .wait=std::chrono::milliseconds{50}}}};
+    size_t initial = env.mapsize();
+    {
+        // a transaction of this thread would never end, growing gives up instead of deadlocking
+        ReadOnlyTxn txn{env};
+        assert(!env.grow() && !env.adopt_mapsize() && env.mapsize() == initial);
+    }
+    {
+        // open transactions are counted, not locked: two on one thread, one
+        // ending on another thread (MDB_NOTLS) are fine
+        std::string notls_path{"test.mdb/grow_notls"};
+        std::filesystem::create_directory(notls_path);
+        Env notls{notls_path, {.flags=EnvArgs::Flags::CREATE | EnvArgs::Flags::NOTLS, .mapsize=64*1024,
+            .growth={.max=1024*1024, .wait=std::chrono::milliseconds{50}}}};
+        ReadOnlyTxn a{notls}, b{notls};
+        std::thread{[txn = std::move(a)]() mutable { txn.abort(); }}.join();
+        assert(!notls.grow());
+        b.abort();
+        assert(notls.grow() && notls.mapsize() > 64*1024);
+    }
+
+    std::string val(1024, 'x');
+    int attempts = 0;
+    with_write_txn(env, [&](Txn& txn)
+    {
+        ++attempts;
+        Dbi dbi = txn.open_dbi();
+        for (int i=0; i<2000; ++i)
+            txn.put(dbi, Val{&i}, Val{val});
+    });
+    assert(attempts > 1 && env.mapsize() > initial);
+
+    int n = with_read_txn(env, [](Txn& txn)
+    {
+        int n = 0;
+        Dbi dbi = txn.open_dbi();
+        KeyValIterator<int, char> it{txn, dbi};
+        for (auto& kv : it)
+            ++n;
+        return n;
+    });
+    assert(n == 2000);
+
+    // without growth transactions aren't counted, the map size can't be adopted safely
+    assert(!fixed.grow() && !fixed.adopt_mapsize());
+}
+
+void codec(Env& env)
+{
+    // encoded bytes sort like the values
+    auto enc = [](auto v)
+    {
+        typedef decltype(v) T;
+        std::string s(Codec<T>::size(v, true), 0);
+        Codec<T>::encode(v, s.data(), true);
+        return s;
+    };
+    assert(enc(-5) < enc(-1) && enc(-1) < enc(0) && enc(0) < enc(7) && enc(7) < enc(1 << 20));
+    assert(enc(-2.5) < enc(-0.5) && enc(-0.5) < enc(0.0) && enc(0.0) < enc(1e-9) && enc(1e-9) < enc(3.0));
+    assert(enc(false) < enc(true) && enc(true).size() == 1);
+    typedef std::tuple<std::string, int> Pair;
+    assert(enc(Pair{"a", 9}) < enc(Pair{std::string("a\0", 2), 1}) && enc(Pair{std::string("a\0", 2), 1}) < enc(Pair{"b", -9}));
+
+    Txn txn{env};
+    auto table = Table<std::tuple<std::string, int64_t>, double>::open(txn);
+    for (int64_t i : {3, -1, 2})
+        table.put(txn, {"k", i}, i * 1.5);
+    table.put(txn, {"j", 100}, 0.0);
+    assert(table.get(txn, {"k", -1}) == -1.5);
+    assert(!table.get(txn, {"k", 4}));
+
+    std::vector<int64_t> seen;
+    for (auto [key, val] : table.range(txn, std::tuple<std::string, int64_t>{"k", INT64_MIN}, std::nullopt))
+        seen.push_back(std::get<1>(key));
+    assert((seen == std::vector<int64_t>{-1, 2, 3}));
+    assert(table.del(txn, {"j", 100}) && !table.del(txn, {"j", 100}));
+
+    // string_view values point straight into the map
+    auto names = Table<uint32_t, std::string_view>::open(txn, "names", DbiFlags::CREATE);
+    names.put(txn, 1, "one");
+    std::string_view one = *names.get(txn, 1);
+    assert(one == "one");
+
+    auto flags = Table<uint32_t, bool>{names.dbi()};
+    flags.overwrite(txn, 2, true);
+    assert(*flags.get(txn, 2) && !flags.get(txn, 3));
+}
+
+struct NativeOrder
+{
+    typedef uint32_t key_type;
+    int operator()(uint32_t a, uint32_t b) const { return (a > b) - (a < b); }
+};
+struct Descending
+{
+    auto operator()(std::string_view a, std::string_view b) const { return b <=> a; }
+};
+struct Numbers
+{
+    static constexpr const char* name = "numbers";
+    static constexpr DbiFlags flags = DbiFlags::CREATE | DbiFlags::DUPSORT;
+    typedef NativeOrder compare;
+    typedef Descending dup_compare;
+};
+
+void comparator(Env& env)
+{
+    Txn txn{env};
+    Dbi dbi = txn.open_dbi<Numbers>();
+    // little endian keys would sort 256 before 1 under memcmp
+    for (uint32_t k : {256u, 1u, 65536u})
+        for (auto v : {"a", "c", "b"})
+            txn.put(dbi, Val{&k}, Val{v});
+
+    std::vector<uint32_t> ks;
+    std::string vs;
+    KeyValIterator<uint32_t, char> it{txn, dbi};
+    for (auto& kv : it)
+    {
+        ks.push_back(*kv.key.data());
+        if (*kv.key.data() == 1)
+            vs.append(kv.val.data(), kv.val.size());
+    }
+    assert((ks == std::vector<uint32_t>{1, 1, 1, 256, 256, 256, 65536, 65536, 65536}));
+    assert(vs == "cba");
+    uint32_t a = 2, b = 300;
+    assert(txn.compare(dbi, Val{&a}, Val{&b}) < 0);
+}
+
+void aggregate(Env& env)
+{
+    Val key{"series"};
+    Txn txn{env};
+    auto dbi = txn.open_dbi(nullptr, DbiFlags::DUPFIXED | DbiFlags::DUPSORT);
+    // enough values to span several pages
+    std::vector<uint32_t> vals(5000);
+    std::iota(vals.begin(), vals.end(), 1);
+    Cursor c{txn, dbi};
+    for (auto& v : vals)
+        c.put(key, Val{&v});
+
+    size_t pages = 0, n = 0;
+    MultiValIterator<decltype(key)::t, uint32_t> it{txn, dbi, key};
+    for (std::span<const uint32_t> page : it)
+    {
+        ++pages;
+        n += page.size();
+    }
+    assert(pages > 1 && n == vals.size());
+
+    assert(sum_dups<uint32_t>(txn, dbi, key) == 5000ull * 5001 / 2);
+    assert((min_max_dups<uint32_t>(txn, dbi, key) == std::pair<uint32_t, uint32_t>{1, 5000}));
+    assert(count_dups_if<uint32_t>(txn, dbi, key, [](uint32_t v) { return v % 10 == 0; }) == 500);
+    std::vector<uint64_t> buckets(5);
+    histogram_dups<uint32_t>(txn, dbi, key, 1u, 1000u, buckets);
+    assert((buckets == std::vector<uint64_t>(5, 1000)));
+
+    std::vector<double> d{1.5, -2.0, 4.0};
+    assert(kernels::sum(std::span<const double>{d}) == 3.5);
+    assert(!kernels::min_max(std::span<const double>{}));
+}
+
+void instrumentation(Env& env)
+{
+    metrics::Histogram h;
+    for (uint64_t v : {3, 100, 1000, 1000, 1000000})
+        h.record(v);
+    assert(h.count == 5 && h.max == 1000000);
+    assert(h.percentile(0) == 3 && h.percentile(0.5) <= 1000 && h.percentile(0.5) >= 1000 - 1000 / 16);
+    for (uint64_t v : {0ull, 15ull, 16ull, 17ull, 12345ull, ~0ull})
+        assert(metrics::Histogram::lower_bound(metrics::Histogram::bucket(v)) <= v);
+
+    Dbi dbi;
+    {
+        Txn txn{env};
+        dbi = txn.open_dbi();
+        txn.put(dbi, Val{"k"}, Val{"v"});
+    }
+    Txn reader{env, MDB_RDONLY};
+    try { reader.get<const char, char>(dbi, Val{"missing"}); }
+    catch (NotFoundError&) {}
+
+    auto s = env.metrics();
+    if (!s.enabled)
+        return;
+    assert(s[metrics::Op::PUT].count >= 1 && s[metrics::Op::TXN_COMMIT].count >= 1);
+    assert(s.errors_of(MDB_NOTFOUND) >= 1);
+    assert(s.read_txn_ages.size() == 1);
+}
+
+void analyzer(Env& env)
+{
+    std::string big(10000, 'x');
+    {
+        Txn txn{env};
+        Dbi dbi = txn.open_dbi();
+        for (int i=0; i<1000; ++i)
+            txn.put(dbi, Val{&i}, Val{&i});
+        int k = -1;
+        txn.put(dbi, Val{&k}, Val{big});
+    }
+    {
+        // frees the pages of the previous version
+        Txn txn{env};
+        Dbi dbi = txn.open_dbi();
+        for (int i=0; i<100; ++i)
+            txn.del(dbi, Val{&i});
+    }
+
+    EnvStats s = analyze(env, {.sample_entries=10});
+    assert(s.page_size > 0 && s.used_pages <= s.map_pages);
+    assert(s.main.entries == 901 && s.main.overflow_pages >= 2 && s.main.leaf_pages > 0);
+    assert(s.main.sampled == 20 && s.main.leaf_fill > 0 && s.main.leaf_fill <= 1);
+    assert(s.free_pages > 0 && s.freelist_entries > 0);
+    assert(s.oldest_reader_txnid == 0 && s.reader_lag() == 0);
+    assert(s.dbis.empty());
+    // none of the main dbi's values look like a dbi record, nothing is opened
+    assert(analyze(env, {.sample_entries=10, .named_dbis=true}).dbis.empty());
+}
+
+void compacting_backup(Env& env)
+{
+    {
+        Txn txn{env};
+        Dbi dbi = txn.open_dbi();
+        std::string val(1000, 'v');
+        for (int i=0; i<200; ++i)
+            txn.put(dbi, Val{&i}, Val{val});
+    }
+
+    size_t calls = 0;
+    uint64_t last = 0;
+    std::string path{"test.mdb/backup"};
+    std::filesystem::create_directory(path);
+    auto progress = lmdbpp::backup(env, path, {.bytes_per_sec=64*1024*1024, .chunk_size=4096, .progress=[&](const BackupProgress& p)
+    {
+        // reads from the pipe may come short of a chunk
+        ++calls;
+        assert(p.bytes > last && p.bytes <= p.expected);
+        last = p.bytes;
+    }});
+    assert(progress.bytes > 0 && calls >= 1 && last == progress.bytes);
+    {
+        Env copy{path};
+        Txn txn{copy, MDB_RDONLY};
+        Dbi dbi = txn.open_dbi();
+        assert(txn.stat(dbi).ms_entries == 200);
+    }
+
+    std::string streamed;
+    lmdbpp::backup(env, [&](std::span<const char> chunk) { streamed.append(chunk.data(), chunk.size()); });
+    assert(streamed.size() == progress.bytes);
+
+    // a failing sink ends the copy, it isn't called again
+    bool thrown = false;
+    calls = 0;
+    try { lmdbpp::backup(env, [&](std::span<const char>) { ++calls; throw std::runtime_error("sink"); }, {.chunk_size=4096}); }
+    catch (std::runtime_error&) { thrown = true; }
+    assert(thrown && calls == 1);
+}
+
+void reader_watchdog(Env&)
+{
+    std::string path{"test.mdb/readers"};
+    std::filesystem::create_directory(path);
+    Env env{path, {.flags=EnvArgs::Flags::CREATE, .mapsize=1024*1024, .maxreaders=7}};
+    assert(env.maxreaders() == 7);
+    assert(env.reader_check() == 0);
+
+    Dbi dbi;
+    {
+        Txn txn{env};
+        dbi = txn.open_dbi();
+    }
+    std::vector<LongReader> reported;
+    ReaderWatchdog watchdog{env, {.interval=std::chrono::hours{1}, .max_age=std::chrono::hours{1}, .max_lag=2,
+        .on_long_reader=[&](const LongReader& r) { reported.push_back(r); }}};
+
+    Txn reader{env, MDB_RDONLY};
+    assert(watchdog.check_now().empty());
+    for (int i=0; i<2; ++i)
+    {
+        Txn txn{env};
+        txn.put(dbi, Val{&i}, Val{&i});
+    }
+    auto long_readers = watchdog.check_now();
+    assert(long_readers.size() == 1 && long_readers[0].lag == 2 && long_readers[0].own_process);
+    // reported only once per transaction
+    watchdog.check_now();
+    assert(reported.size() == 1);
+    reader.abort();
+    assert(watchdog.check_now().empty());
+
+    // whatever the background rounds throw is reported, and they go on
+    std::atomic<int> errors{0};
+    {
+        ReaderWatchdog failing{env, {.interval=std::chrono::milliseconds{5}, .max_age=std::chrono::milliseconds{0},
+            .on_long_reader=[](const LongReader&) { throw std::logic_error("callback"); },
+            .on_error=[&](std::exception_ptr e)
+            {
+                try { std::rethrow_exception(e); }
+                catch (std::logic_error&) { ++errors; }
+            }}};
+        Txn old{env, MDB_RDONLY};
+        for (int i=0; i<1000 && errors == 0; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds{5});
+    }
+    assert(errors >= 1);
+}
+
+template <typename T>
+concept Writable = requires (T& txn, Dbi dbi) { txn.put(dbi, Val{"k"}, Val{"v"}); };
+
+void nested(Env& env)
+{
+    WriteTxn txn{env};
+    Dbi dbi = txn.open_dbi();
+    txn.put(dbi, Val{"a"}, Val{"1"});
+    {
+        WriteTxn child = txn.begin_nested();
+        child.put(dbi, Val{"b"}, Val{"2"});
+        child.abort();
+    }
+    {
+        WriteTxn child = txn.begin_nested();
+        child.put(dbi, Val{"c"}, Val{"3"});
+    }
+    assert((txn.try_get<const char, char>(dbi, Val{"a"}) && !txn.try_get<const char, char>(dbi, Val{"b"}) && txn.try_get<const char, char>(dbi, Val{"c"})));
+    static_assert(std::is_move_constructible_v<WriteTxn> && std::is_move_assignable_v<WriteTxn> && !std::is_copy_constructible_v<WriteTxn>);
+    {
+        std::optional<WriteTxn> child;
+        child = txn.begin_nested();
+        WriteTxn handed = std::move(*child);
+        handed.put(dbi, Val{"d"}, Val{"4"});
+        handed.abort();
+    }
+    assert((!txn.try_get<const char, char>(dbi, Val{"d"})));
+
+    // transactions and cursors move between owners
+    Txn moved = std::move(txn);
+    std::vector<Txn> stage;
+    stage.push_back(std::move(moved));
+    stage.back().commit();
+
+    // ended before the pool's, one read-only transaction per thread without MDB_NOTLS
+    {
+        ReadOnlyTxn ro{env};
+        Cursor c{ro, dbi};
+        Cursor other = Cursor::borrow(ro, dbi);
+        other = std::move(c);
+        assert((other.first<char, char>().key.to_str() == "a"));
+    }
+
+    ReadTxnPool pool{env};
+    ReadTxn a{pool};
+    ReadTxn b = std::move(a);
+    assert((b.try_get<const char, char>(dbi, Val{"c"})));
+    static_assert(!Writable<ReadOnlyTxn> && Writable<WriteTxn>);
+}
+
+Task<void> serve(AsyncEnv& db, Dbi dbi, int i, std::vector<int>& served)
+{
+    std::string key = "k" + std::to_string(i);
+    co_await db.put(dbi, key, std::to_string(i));
+    auto val = co_await db.get(dbi, key);
+    assert(val && *val == std::to_string(i));
+    // resumed on the loop's thread, no locking needed
+    served.push_back(i);
+}
+void coroutines(Env& env)
+{
+    Dbi dbi;
+    {
+        Txn txn{env};
+        dbi = txn.open_dbi();
+    }
+    AsyncEnv db{env};
+    EventLoop loop;
+    std::vector<int> served;
+    for (int i=0; i<100; ++i)
+        loop.spawn(serve(db, dbi, i, served));
+    loop.run();
+    assert(served.size() == 100);
+
+    // outside of coroutines, with reads on their own threads
+    AsyncEnv pooled{env, {.reader_threads=2}};
+    auto vals = sync_wait(pooled.get_many(dbi, {"k7", "nope", "k42"}));
+    assert(vals[0] == "7" && !vals[1] && vals[2] == "42");
+    bool threw = false;
+    try { sync_wait(db.put(dbi, "k1", "again")); }
+    catch (KeyExistsError&) { threw = true; }
+    assert(threw);
+    size_t n = sync_wait(db.write([&](WriteTxn& txn) { return txn.stat(dbi).ms_entries; }));
+    assert(n == 100);
+}
+
+void sharding(Env&)
+{
+    RangePartitioner ranges{{"h", "p"}};
+    assert(ranges("c", 3) == 0 && ranges("h", 3) == 1 && ranges("x", 3) == 2);
+    try { ShardedEnv none{{}}; assert(false); }
+    catch (Error&) {}
+
+    std::vector<std::string> paths;
+    for (int i=0; i<3; ++i)
+    {
+        paths.push_back("test.mdb/shard" + std::to_string(i));
+        std::filesystem::create_directory(paths.back());
+    }
+    ShardedEnv sharded{paths, {.env={.flags=EnvArgs::Flags::CREATE, .mapsize=1024*1024}}};
+    ShardedDbi dbi = sharded.open_dbi();
+    std::vector<std::string> keys;
+    for (char c='a'; c<='z'; ++c)
+    {
+        keys.emplace_back(1, c);
+        sharded.put(dbi, keys.back(), "v");
+    }
+    sharded.flush();
+    assert(sharded.get(dbi, "q") == "v" && !sharded.get(dbi, "?"));
+
+    // one key order across shards
+    std::vector<std::string> scanned;
+    std::set<size_t> shards;
+    // ended before the next scan, one read-only transaction per shard and thread without MDB_NOTLS
+    {
+        auto all = sharded.scan(dbi);
+        for (auto& kv : all)
+        {
+            scanned.push_back(kv.key.to_str());
+            shards.insert(all.shard());
+        }
+    }
+    assert(scanned == keys && shards.size() == 3);
+    scanned.clear();
+    for (auto& kv : sharded.scan(dbi, "f", "i", Order::REVERSE))
+        scanned.push_back(kv.key.to_str());
+    assert((scanned == std::vector<std::string>{"h", "g", "f"}));
+
+    auto batch = sharded.batch();
+    for (auto k : {"ba", "ca", "da", "ea"})
+        batch.put(dbi, k, "batch");
+    batch.del(dbi, "a");
+    batch.commit();
+    assert(sharded.get(dbi, "da") == "batch" && !sharded.get(dbi, "a"));
+
+    // one failing op and none of the batch is written
+    batch.put(dbi, "fa", "batch");
+    batch.put(dbi, "b", "exists");
+    bool threw = false;
+    try { batch.commit(); }
+    catch (KeyExistsError&) { threw = true; }
+    assert(threw && !sharded.get(dbi, "fa") && sharded.get(dbi, "b") == "v");
+}
+
+void key_filter(Env& env)
+{
+    Dbi dbi;
+    {
+        Txn txn{env};
+        dbi = txn.open_dbi();
+        for (int i=0; i<100; ++i)
+            txn.put(dbi, Val{&i}, Val{&i});
+    }
+    std::string sidecar{"test.mdb/filter"};
+    {
+        KeyFilter filter{env, dbi, {.path=sidecar}};
+        assert(!filter.loaded() && env.filter(dbi) == &filter.bloom());
+        Txn txn{env};
+        int k = 100;
+        txn.put(dbi, Val{&k}, Val{&k});
+        for (int i=0; i<=100; ++i)
+            assert((txn.try_get<int, int>(dbi, Val{&i})));
+        size_t maybe = 0;
+        for (int i=1000; i<11000; ++i)
+            maybe += filter.may_contain({(const char*)&i, sizeof(i)});
+        assert(maybe < 100);
+        int absent = 5000;
+        std::vector<Val<int>> keys{Val{&k}, Val{&absent}};
+        std::vector<Val<const int>> vals(2);
+        assert((txn.get_many<int, int>(dbi, keys, vals) == 1));
+    }
+    // saved when destroyed, loaded as long as nothing was written since
+    {
+        KeyFilter filter{env, dbi, {.path=sidecar}};
+        assert(filter.loaded());
+    }
+    int k = -1;
+    {
+        Txn txn{env};
+        txn.put(dbi, Val{&k}, Val{&k});
+    }
+    {
+        KeyFilter filter{env, dbi, {.path=sidecar}};
+        assert(!filter.loaded());
+        Txn txn{env, MDB_RDONLY};
+        assert((txn.try_get<int, int>(dbi, Val{&k})));
+    }
+    assert(env.filter(dbi) == nullptr);
+
+    // snapshots older than the filter skip it, they may still hold keys deleted before the scan
+    std::string path{"test.mdb/filter_snapshot"};
+    std::filesystem::create_directory(path);
+    Env snap{path, {.flags=EnvArgs::Flags::CREATE | EnvArgs::Flags::NOTLS, .mapsize=1024*1024}};
+    int gone = 7;
+    {
+        Txn txn{snap};
+        dbi = txn.open_dbi();
+        txn.put(dbi, Val{&gone}, Val{&gone});
+    }
+    ReadOnlyTxn old{snap};
+    {
+        Txn txn{snap};
+        txn.del(dbi, Val{&gone});
+    }
+    {
+        KeyFilter filter{snap, dbi};
+        assert(!filter.may_contain({(const char*)&gone, sizeof(gone)}));
+        assert((old.try_get<int, int>(dbi, Val{&gone})));
+        std::vector<Val<int>> keys{Val{&gone}};
+        std::vector<Val<const int>> vals(1);
+        assert((old.get_many<int, int>(dbi, keys, vals) == 1));
+        ReadOnlyTxn now{snap};
+        assert((!now.try_get<int, int>(dbi, Val{&gone})));
+        now.abort();
+        old.abort();
+    }
+}
+
+void decoded_cache(Env&)
+{
+    // two snapshots at once on one thread need MDB_NOTLS
+    std::string path{"test.mdb/cache"};
+    std::filesystem::create_directory(path);
+    Env env{path, {.flags=EnvArgs::Flags::CREATE | EnvArgs::Flags::NOTLS, .mapsize=1024*1024}};
+    typedef Table<std::string, std::string> Names;
+    Names table = [&]
+    {
+        Txn txn{env};
+        Names t = Names::open(txn);
+        t.put(txn, "alice", "v1");
+        return t;
+    }();
+    {
+        // a writer already running when a cache is made commits before it
+        std::atomic<bool> started{false}, committing{false};
+        std::thread writer{[&]
+        {
+            Txn txn{env};
+            started = true;
+            std::this_thread::sleep_for(std::chrono::milliseconds{20});
+            table.overwrite(txn, "alice", "v1");
+            committing = true;
+            txn.commit();
+        }};
+        while (!started)
+            std::this_thread::yield();
+        CachedTable<std::string, std::string> fenced{env, table};
+        assert(committing);
+        writer.join();
+    }
+    CachedTable<std::string, std::string> cache{env, table, {.capacity=4, .shards=1}};
+
+    ReadOnlyTxn old{env};
+    auto first = cache.get(old, "alice");
+    assert(*first == "v1" && cache.get(old, "alice") == first);
+    {
+        WriteTxn txn{env};
+        cache.overwrite(txn, "alice", "v2");
+        assert(*cache.get(txn, "alice") == "v2");
+    }
+    // the old snapshot keeps hitting its value, new ones see the write
+    assert(cache.get(old, "alice") == first);
+    ReadOnlyTxn now{env};
+    assert(*cache.get(now, "alice") == "v2" && *cache.get(now, "alice") == "v2");
+    assert(!cache.get(now, "bob") && !cache.get(now, "bob"));
+    auto s = cache.stats();
+    assert(s.hits == 4 && s.misses == 3);
+    // replaced by the newer snapshot's entry, read from the table again
+    assert(*cache.get(old, "alice") == "v1");
+    assert(cache.stats().misses == 4);
+
+    // bounded, evicted keys come back from the table
+    for (auto k : {"a", "b", "c", "d", "e"})
+        cache.get(now, k);
+    assert(cache.stats().evictions > 0 && *cache.get(now, "alice") == "v2");
+}
+
+void change_capture(Env&)
+{
+    std::string leader_path{"test.mdb/leader"}, replica_path{"test.mdb/replica"};
+    std::filesystem::create_directory(leader_path);
+    std::filesystem::create_directory(replica_path);
+    Env leader{leader_path, {.flags=EnvArgs::Flags::CREATE, .mapsize=1024*1024, .maxdbs=4}};
+    Env replica{replica_path, {.flags=EnvArgs::Flags::CREATE, .mapsize=1024*1024, .maxdbs=4}};
+
+    Dbi log, names, tags;
+    {
+        Txn txn{leader};
+        log = txn.open_dbi("changes", DbiFlags::CREATE);
+        names = txn.open_dbi("names", DbiFlags::CREATE);
+        tags = txn.open_dbi("tags", DbiFlags::CREATE | DbiFlags::DUPSORT);
+    }
+    ChangeLog changes{log};
+    changes.track(names, "names");
+    changes.track(tags, "tags");
+    leader.set_change_log(&changes);
+
+    {
+        Txn txn{leader};
+        txn.put(names, Val{"alice"}, Val{"a"});
+        txn.put(names, Val{"bob"}, Val{"b"});
+        txn.reserve(names, Val{"carol"}, 1)[0] = 'c';
+        txn.put(tags, Val{"alice"}, Val{"x"});
+        txn.put(tags, Val{"alice"}, Val{"y"});
+    }
+    {
+        Txn txn{leader};
+        txn.put(names, Val{"dave"}, Val{"d"});
+        txn.abort();
+    }
+    {
+        Txn txn{leader};
+        txn.del(names, Val{"bob"});
+        txn.del(tags, Val{"alice"}, Val{"x"});
+    }
+
+    // in commit order, reserved values once filled in, nothing of the aborted txn
+    std::vector<std::string> seen;
+    std::set<uint64_t> txnids;
+    ChangeReader reader{leader, log};
+    assert(reader.poll([&](const Change& c) { seen.push_back(std::string{c.dbi} + ":" + std::string{c.key} + "=" + std::string{c.val}); }, 2) == 2);
+    assert(reader.position() == 2);
+    assert(reader.poll([&](const Change& c)
+    {
+        seen.push_back(std::string{c.dbi} + ":" + std::string{c.key} + "=" + std::string{c.val});
+        txnids.insert(c.txnid);
+        if (c.dbi == "tags")
+            assert(c.flags & MDB_DUPSORT);
+        if (c.seq > 5)
+            assert(c.op == (c.dbi == "tags" ? ChangeOp::DEL_DUP : ChangeOp::DEL));
+    }) == 5);
+    assert((seen == std::vector<std::string>{"names:alice=a", "names:bob=b", "tags:alice=x", "tags:alice=y", "names:carol=c", "names:bob=", "tags:alice=x"}));
+    assert(txnids.size() == 2 && reader.position() == 8);
+    assert(reader.poll([](const Change&) {}) == 0);
+
+    {
+        // batches are rounded up to whole leader transactions
+        Follower follower{leader, log, replica, {.batch=3}};
+        assert(follower.step() == 5 && follower.position() == 5);
+        assert(follower.catch_up() == 2 && follower.position() == 8);
+        assert(follower.catch_up() == 0);
+    }
+    {
+        Txn txn{leader};
+        txn.put(names, Val{"erin"}, Val{"e"});
+        Cursor c{txn, names};
+        c.seek(Val{"carol"});
+        c.del();
+    }
+    {
+        // picks up where the last one left off
+        Follower follower{leader, log, replica};
+        assert(follower.catch_up() == 2 && follower.position() == 10);
+    }
+    {
+        ReadOnlyTxn txn{replica};
+        Dbi r_names = txn.open_dbi("names"), r_tags = txn.open_dbi("tags");
+        assert((txn.get<const char, char>(r_names, Val{"alice"}).to_str() == "a"));
+        assert((txn.get<const char, char>(r_names, Val{"erin"}).to_str() == "e"));
+        assert((!txn.try_get<const char, char>(r_names, Val{"bob"}) && !txn.try_get<const char, char>(r_names, Val{"carol"})));
+        assert(txn.stat(r_names).ms_entries == 2 && txn.stat(r_tags).ms_entries == 1);
+        assert((txn.get<const char, char>(r_tags, Val{"alice"}).to_str() == "y"));
+    }
+
+    {
+        Txn txn{leader};
+        assert(trim_change_log(txn, log, 5) == 5);
+    }
+    // readers behind the trimmed part fail instead of skipping it
+    ChangeReader rest{leader, log};
+    try { rest.poll([](const Change&) {}); assert(false); }
+    catch (ChangeLogTrimmedError& e) { assert(e.position == 0 && e.trimmed == 5); }
+    rest.seek(5);
+    assert(rest.poll([](const Change&) {}) == 4 && rest.position() == 10);
+    {
+        Follower late{leader, log, replica, {.name="late"}};
+        try { late.catch_up(); assert(false); }
+        catch (ChangeLogTrimmedError&) {}
+    }
+    // trimmed empty, sequence numbers carry on
+    {
+        Txn txn{leader};
+        assert(trim_change_log(txn, log, 100) == 4);
+    }
+    {
+        Txn txn{leader};
+        txn.put(names, Val{"fred"}, Val{"f"});
+    }
+
+    // a follower on its own thread
+    std::atomic<int> errors{0};
+    Follower background{leader, log, replica, {.interval=std::chrono::milliseconds{5}, .on_error=[&](std::exception_ptr) { ++errors; }}};
+    for (int i = 0; i < 400 && background.position() != 11; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds{5});
+    assert(background.position() == 11 && errors == 0);
+    leader.set_change_log(nullptr);
+}
+
+void secondary_index(Env&)
+{
+    std::string path{"test.mdb/index"};
+    std::filesystem::create_directory(path);
+    Env env{path, {.flags=EnvArgs::Flags::CREATE, .mapsize=1024*1024, .maxdbs=3}};
+    typedef std::tuple<std::string, uint32_t> User;     // name, age
+    typedef Index<uint32_t, uint32_t, User> ByAge;
+    typedef Index<char, uint32_t, User> ByInitial;
+
+    Txn txn{env};
+    auto table = Table<uint32_t, User>::open(txn, "users", DbiFlags::CREATE);
+    ByAge by_age = ByAge::open(txn, "by_age", [](const User& u, std::vector<uint32_t>& out) { out.push_back(std::get<1>(u)); });
+    assert((txn.dbi_flags(by_age.dbi()) & DbiFlags::DUPFIXED) != DbiFlags::NONE);
+    IndexedTable<uint32_t, User> users{table};
+    users.attach(by_age);
+    try { IndexedTable<uint32_t, User> dups{Table<uint32_t, User>{table.dbi(), true}}; assert(false); }
+    catch (Error&) {}
+
+    users.put(txn, 1, {"alice", 30});
+    users.put(txn, 2, {"bob", 25});
+    users.put(txn, 4, {"carol", 30});
+    users.put(txn, 3, {"dave", 40});
+    auto ids = [](auto&& lookup)
+    {
+        std::vector<uint32_t> out;
+        for (const auto& [id, user] : lookup)
+            out.push_back(id);
+        return out;
+    };
+    assert((ids(by_age.find(txn, table, 30)) == std::vector<uint32_t>{1, 4}));
+    assert(by_age.count(txn, 30) == 2 && by_age.count(txn, 99) == 0);
+
+    // updates move entries, deletes drop them
+    users.overwrite(txn, 2, {"bob", 30});
+    assert((ids(by_age.find(txn, table, 30)) == std::vector<uint32_t>{1, 2, 4}));
+    assert(ids(by_age.find(txn, table, 25)).empty());
+    assert(users.del(txn, 1) && !users.del(txn, 1));
+    assert((ids(by_age.find(txn, table, 30)) == std::vector<uint32_t>{2, 4}));
+    try { users.put(txn, 2, {"bob", 50}); assert(false); }
+    catch (KeyExistsError&) {}
+    assert(by_age.count(txn, 50) == 0);
+
+    // sorted by primary key within a batch, by age across them
+    assert((ids(by_age.range(txn, table, 26, std::nullopt)) == std::vector<uint32_t>{2, 3, 4}));
+    assert((ids(by_age.range(txn, table, 26, 41, 2)) == std::vector<uint32_t>{2, 4, 3}));
+    std::vector<std::pair<uint32_t, User>> found;
+    for (auto kv : by_age.find(txn, table, 40))
+        found.push_back(kv);
+    assert((found == std::vector<std::pair<uint32_t, User>>{{3, {"dave", 40}}}));
+
+    // several keys per value, added to a table with values in it
+    ByInitial by_initial = ByInitial::open(txn, "by_initial", [](const User& u, std::vector<char>& out)
+    {
+        out.push_back(std::get<0>(u).front());
+        out.push_back(std::get<0>(u).back());
+    });
+    by_initial.rebuild(txn, table);
+    users.attach(by_initial);
+    users.put(txn, 5, {"erin", 20});
+    assert((ids(by_initial.find(txn, table, 'b')) == std::vector<uint32_t>{2}));
+    assert((ids(by_initial.find(txn, table, 'n')) == std::vector<uint32_t>{5}));
+    assert((ids(by_initial.range(txn, table, 'c', 'f')) == std::vector<uint32_t>{3, 3, 4, 5}));
+}
+
 int main()
 {
     std::string env_path{"test.mdb"};
@@ -113,7 +1219,32 @@ int main()
         cursor,
         abort,
         multi,
-        dup
+        dup,
+        try_api,
+        pooled_read,
+        cursor_cache,
+        group_commit,
+        reserve,
+        ranges,
+        parallel,
+        get_many,
+        bulk_load,
+        bulk_load_dupfixed,
+        map_growth,
+        codec,
+        comparator,
+        aggregate,
+        instrumentation,
+        analyzer,
+        compacting_backup,
+        reader_watchdog,
+        nested,
+        coroutines,
+        sharding,
+        key_filter,
+        decoded_cache,
+        change_capture,
+        secondary_index
     };
     for (auto test : tests)
     {
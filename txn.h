@@ -2,6 +2,18 @@
 #define __lmdbpp_txn_h
 
 #include <lmdb.h>
+#include <algorithm>
+#include <cerrno>
+#include <concepts>
+#include <cstring>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
 #include "error.h"
 #include "env.h"
 #include "val.h"
@@ -25,14 +37,85 @@ enum class DbiFlags
 constexpr DbiFlags operator|(DbiFlags a, DbiFlags b) { return (DbiFlags)((int)a|(int)b); }
 constexpr DbiFlags operator&(DbiFlags a, DbiFlags b) { return (DbiFlags)((int)a&(int)b); }
 
+// Turns a comparator type into the C callback LMDB wants, resolved at compile
+// time so the comparison itself gets inlined into the callback. Cmp is default
+// constructed and called with two std::string_view, or, if it declares a
+// key_type, with two const key_type& for fixed width keys (which then have to
+// be exactly sizeof(key_type) bytes). It returns <0, 0, >0 or a std::*_ordering.
+template <typename Cmp>
+struct CompareAdapter
+{
+    static int compare(const MDB_val* a, const MDB_val* b)
+    {
+        if constexpr (requires { typename Cmp::key_type; })
+        {
+            typedef typename Cmp::key_type T;
+            static_assert(std::is_trivially_copyable_v<T>);
+            if (a->mv_size != sizeof(T) || b->mv_size != sizeof(T))
+                return a->mv_size < b->mv_size ? -1 : a->mv_size > b->mv_size;
+            T x, y;
+            std::memcpy(&x, a->mv_data, sizeof(T));
+            std::memcpy(&y, b->mv_data, sizeof(T));
+            return _int(Cmp{}(x, y));
+        }
+        else
+        {
+            return _int(Cmp{}(std::string_view{(const char*)a->mv_data, a->mv_size}, std::string_view{(const char*)b->mv_data, b->mv_size}));
+        }
+    }
+
+private:
+    template <typename R>
+    static int _int(R r) { return r < 0 ? -1 : r > 0 ? 1 : 0; }
+};
+
+template <typename Cmp>
+constexpr MDB_cmp_func* compare_func = &CompareAdapter<Cmp>::compare;
+
+// A dbi described as a type, so every process opening it also installs the
+// same comparators (LMDB does not persist them, and a dbi opened without its
+// comparator silently misorders):
+//
+//   struct Events
+//   {
+//       static constexpr const char* name = "events";
+//       static constexpr DbiFlags flags = DbiFlags::CREATE | DbiFlags::DUPSORT;
+//       typedef ByTimestamp compare;       // optional
+//       typedef ByPayload dup_compare;     // optional
+//   };
+//   Dbi dbi = txn.open_dbi<Events>();
+template <typename S>
+concept DbiSpec = requires
+{
+    { S::name } -> std::convertible_to<const char*>;
+    { S::flags } -> std::convertible_to<DbiFlags>;
+};
+
+namespace detail
+{
+template <typename S> struct spec_compare { typedef void type; };
+template <typename S> requires requires { typename S::compare; } struct spec_compare<S> { typedef typename S::compare type; };
+template <typename S> struct spec_dup_compare { typedef void type; };
+template <typename S> requires requires { typename S::dup_compare; } struct spec_dup_compare<S> { typedef typename S::dup_compare type; };
+}  // namespace detail
+
+// idle cursor kept open by a Txn for reuse, stale ones need mdb_cursor_renew first
+struct CachedCursor
+{
+    Dbi dbi;
+    MDB_cursor* cursor;
+    bool stale;
+};
+
 class Txn
 {
 public:
     Txn(Env& env, unsigned int flags = 0)
-        : _env(env)
+        : _env(&env)
         , _autocommit(true)
     {
-        check(mdb_txn_begin(_env.mdb_env(), nullptr, flags, &_txn));
+        _pass_resize_gate();
+        _begin(nullptr, flags);
     };
 
     ~Txn()
@@ -41,29 +124,180 @@ public:
             commit();
     }
 
-    Txn& operator=(Txn&& o) = delete;
-    Txn(Txn&& o) = delete;
-    Txn(Txn& o) = delete;
+    // Moving hands over the transaction and its cursor cache, the moved-from
+    // Txn is left ended. Cursors and iterators refer to the Txn object, so
+    // only move one while none of them are open.
+    Txn(Txn&& o)
+        : _txn(std::exchange(o._txn, nullptr))
+        , _rdonly(o._rdonly)
+        , _cursors(std::move(o._cursors))
+        , _resize_pass(std::move(o._resize_pass))
+        , _env(o._env)
+        , _autocommit(o._autocommit)
+        , _reserved(std::move(o._reserved))
+    {
+    }
+
+    // ends the current transaction the way the destructor would, then takes over o's
+    Txn& operator=(Txn&& o)
+    {
+        if (this == &o)
+            return *this;
+        if (_txn != nullptr)
+        {
+            if (_autocommit)
+                commit();
+            else
+                abort();
+        }
+        _txn = std::exchange(o._txn, nullptr);
+        _rdonly = o._rdonly;
+        _cursors = std::move(o._cursors);
+        _resize_pass = std::move(o._resize_pass);
+        _env = o._env;
+        _autocommit = o._autocommit;
+        _reserved = std::move(o._reserved);
+        return *this;
+    }
+
+    Txn(const Txn& o) = delete;
+    Txn& operator=(const Txn& o) = delete;
+
+    // Starts a child transaction (this has to be a write transaction). While it
+    // runs this one must not be used; committing it folds its changes into this
+    // one, aborting it rolls back only what was done in it.
+    Txn begin_nested() { return Txn{*this, 0}; }
+
+    Env& env() const { return *_env; }
 
     void commit()
     {
-        check(mdb_txn_commit(_txn));
+        if (!_reserved.empty())
+        {
+            try { _log_reserved(); }
+            catch (...) { abort(); throw; }
+        }
+        _close_cursors();
+        _env->reader_ages().end(_txn);
+        int rc;
+        {
+            metrics::Timer t{metrics::Op::TXN_COMMIT};
+            rc = mdb_txn_commit(_txn);
+        }
+        _txn = nullptr;
+        _resize_pass = {};
+        check(rc);
     }
 
     void abort()
     {
-        mdb_txn_abort(_txn);
+        _close_cursors();
+        if (_txn != nullptr)
+        {
+            _env->reader_ages().end(_txn);
+            metrics::Timer t{metrics::Op::TXN_ABORT};
+            mdb_txn_abort(_txn);
+        }
+        _txn = nullptr;
+        _resize_pass = {};
         _autocommit = false;
+        _reserved.clear();
     }
 
+#define TPL_K template <typename TKey>
 #define TPL_KV template <typename TKey, typename TVal>
 #define TPL_VK template <typename TKey, typename TVal>
 
-    TPL_KV void get(Dbi dbi, const Val<TKey>& key, Val<const TVal>& val) { check(mdb_get(_txn, dbi, key.mdb_val(), val.mdb_val())); }
+    TPL_KV void get(Dbi dbi, const Val<TKey>& key, Val<const TVal>& val) { check(_get(dbi, key.mdb_val(), val.mdb_val())); }
     TPL_VK auto get(Dbi dbi, const Val<TKey>& key) { Val<const TVal> v{}; get(dbi, key, v); return v; }
     TPL_VK auto get(Dbi dbi, const TKey* key) { return get(dbi, Val{key}); }
     TPL_VK auto get(Dbi dbi, const TKey& key) { return get(dbi, Val{&key}); }
 
+    // Looks up every keys[i] into out[i] (null data if missing) and returns how many were found.
+    // Keys are visited in dbi order with a single cursor: a key right after the previous hit is
+    // resolved with one MDB_NEXT_NODUP, everything else with MDB_SET_KEY, which stays on the
+    // current leaf page when it can. Pass sorted = true if keys already are in dbi order.
+    // out has to be at least as long as keys, EINVAL otherwise.
+    TPL_KV size_t get_many(Dbi dbi, std::span<const Val<TKey>> keys, std::span<Val<const TVal>> out, bool sorted = false)
+    {
+        if (out.size() < keys.size())
+            check(EINVAL);
+        std::vector<size_t> order;
+        if (!sorted)
+        {
+            order.resize(keys.size());
+            std::iota(order.begin(), order.end(), 0);
+            std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return compare(dbi, keys[a], keys[b]) < 0; });
+        }
+
+        BloomFilter* filter = _env->filter(dbi);
+        if (filter != nullptr && !filter->covers(mdb_txn_id(_txn)))
+            filter = nullptr;
+        MDB_cursor* cursor = acquire_cursor(dbi);
+        MDB_val cur_key{0, nullptr}, cur_val{0, nullptr};
+        bool positioned = false, exhausted = false;
+        size_t found = 0;
+        int rc = 0;
+        for (size_t i = 0; i < keys.size() && rc == 0; ++i)
+        {
+            size_t k = sorted ? i : order[i];
+            MDB_val* key = keys[k].mdb_val();
+            if (filter != nullptr && !filter->may_contain(key))
+            {
+                out[k].set(nullptr, 0);
+                continue;
+            }
+            int cmp = -1;
+            if (positioned)
+            {
+                cmp = mdb_cmp(_txn, dbi, &cur_key, key);
+                if (cmp < 0)
+                {
+                    rc = mdb_cursor_get(cursor, &cur_key, &cur_val, MDB_NEXT_NODUP);
+                    if (rc == 0)
+                    {
+                        cmp = mdb_cmp(_txn, dbi, &cur_key, key);
+                    }
+                    else if (rc == MDB_NOTFOUND)
+                    {
+                        // every key left is past the last one
+                        rc = 0;
+                        positioned = false;
+                        exhausted = true;
+                    }
+                }
+            }
+            if (!exhausted && rc == 0 && !(positioned && cmp >= 0))
+            {
+                cur_key = *key;
+                rc = mdb_cursor_get(cursor, &cur_key, &cur_val, MDB_SET_KEY);
+                positioned = rc == 0;
+                cmp = 0;
+                if (rc == MDB_NOTFOUND)
+                    rc = 0;
+            }
+            bool hit = positioned && cmp == 0;
+            if (hit)
+            {
+                out[k].set((const TVal*)cur_val.mv_data, cur_val.mv_size);
+                ++found;
+            }
+            else
+            {
+                out[k].set(nullptr, 0);
+            }
+        }
+        release_cursor(dbi, cursor);
+        check(rc);
+        return found;
+    }
+
+    // non-throwing variants of get(), a missing key is reported as false/nullopt
+    TPL_KV bool try_get(Dbi dbi, const Val<TKey>& key, Val<const TVal>& val) { return check_found(_get(dbi, key.mdb_val(), val.mdb_val())); }
+    TPL_VK std::optional<Val<const TVal>> try_get(Dbi dbi, const Val<TKey>& key) { Val<const TVal> v{}; if (!try_get(dbi, key, v)) return std::nullopt; return v; }
+    TPL_VK auto try_get(Dbi dbi, const TKey* key) { return try_get<const TKey, TVal>(dbi, Val{key}); }
+    TPL_VK auto try_get(Dbi dbi, const TKey& key) { return try_get<const TKey, TVal>(dbi, Val{&key}); }
+
 #define FUNC(NAME, FLAGS) \
     TPL_KV void NAME(Dbi dbi, const Val<TKey>& key, const Val<TVal>& val) { _put(dbi, key.mdb_val(), val.mdb_val(), FLAGS); } \
     TPL_KV void NAME(Dbi dbi, const KeyVal<TKey, TVal>& kv) { NAME(dbi, kv.key, kv.val); } \
@@ -77,13 +311,26 @@ public:
 
 #undef FUNC
 
-    TPL_KV void del(Dbi dbi, const Val<TKey>& key, const Val<TKey>& val) { _del(dbi, key.mdb_val(), val.mdb_val()); }
-    TPL_KV void del(Dbi dbi, const KeyVal<TKey,TVal>& kv) { del(kv.key, kv.val); }
-    TPL_KV void del(Dbi dbi, const TKey* key, const TVal* val) { del(Val{key}, Val{val}); }
-    TPL_KV void del(Dbi dbi, const TKey& key, const TVal& val) { del(Val{&key}, Val{&val}); }
-    TPL_KV void del(Dbi dbi, const Val<TKey>& key) { _del(dbi, key.mdb_val(), nullptr); }
-    TPL_KV void del(Dbi dbi, const TKey* key) { del(Val{key}); }
-    TPL_KV void del(Dbi dbi, const TKey& key) { del(Val{&key}); }
+    // MDB_RESERVE: makes room for a `size` byte value and returns it for the caller to fill
+    // in place, before anything else is written in this transaction. Not for DUPSORT dbis.
+    // The overloads taking `writer` call writer(std::span<char>) to serialize straight into it.
+#define FUNC(NAME, FLAGS) \
+    TPL_K std::span<char> NAME(Dbi dbi, const Val<TKey>& key, size_t size) { MDB_val v{size, nullptr}; _put(dbi, key.mdb_val(), &v, MDB_RESERVE | FLAGS); return {(char*)v.mv_data, v.mv_size}; } \
+    template <typename TKey, typename TWriter> void NAME(Dbi dbi, const Val<TKey>& key, size_t size, TWriter&& writer) { writer(NAME(dbi, key, size)); }
+
+    FUNC(reserve, MDB_NOOVERWRITE)
+    FUNC(reserve_overwrite, 0)
+    FUNC(reserve_append, MDB_APPEND)
+
+#undef FUNC
+
+    TPL_KV void del(Dbi dbi, const Val<TKey>& key, const Val<TVal>& val) { _del(dbi, key.mdb_val(), val.mdb_val()); }
+    TPL_KV void del(Dbi dbi, const KeyVal<TKey,TVal>& kv) { del(dbi, kv.key, kv.val); }
+    TPL_KV void del(Dbi dbi, const TKey* key, const TVal* val) { del(dbi, Val{key}, Val{val}); }
+    TPL_KV void del(Dbi dbi, const TKey& key, const TVal& val) { del(dbi, Val{&key}, Val{&val}); }
+    TPL_K void del(Dbi dbi, const Val<TKey>& key) { _del(dbi, key.mdb_val(), nullptr); }
+    TPL_K void del(Dbi dbi, const TKey* key) { del(dbi, Val{key}); }
+    TPL_K void del(Dbi dbi, const TKey& key) { del(dbi, Val{&key}); }
 
     Dbi open_dbi(const char* name = nullptr, DbiFlags flags = DbiFlags::NONE)
     {
@@ -92,6 +339,35 @@ public:
         return dbi;
     }
 
+    // opens dbi and installs Cmp as its key comparator and DupCmp as its
+    // duplicate comparator, void keeps LMDB's default for either
+    template <typename Cmp, typename DupCmp = void>
+    Dbi open_dbi(const char* name, DbiFlags flags = DbiFlags::NONE)
+    {
+        Dbi dbi = open_dbi(name, flags);
+        if constexpr (!std::is_void_v<Cmp>)
+            check(mdb_set_compare(_txn, dbi, compare_func<Cmp>));
+        if constexpr (!std::is_void_v<DupCmp>)
+            check(mdb_set_dupsort(_txn, dbi, compare_func<DupCmp>));
+        return dbi;
+    }
+
+    template <DbiSpec S>
+    Dbi open_dbi()
+    {
+        return open_dbi<typename detail::spec_compare<S>::type, typename detail::spec_dup_compare<S>::type>(S::name, S::flags);
+    }
+
+    // compares two keys the way dbi orders them (mdb_cmp)
+    TPL_K int compare(Dbi dbi, const Val<TKey>& a, const Val<TKey>& b) { return mdb_cmp(_txn, dbi, a.mdb_val(), b.mdb_val()); }
+
+    MDB_stat stat(Dbi dbi)
+    {
+        MDB_stat s;
+        check(mdb_stat(_txn, dbi, &s));
+        return s;
+    }
+
     DbiFlags dbi_flags(Dbi dbi)
     {
         unsigned int f = 0;
@@ -104,18 +380,275 @@ public:
         return const_cast<MDB_txn*>(_txn);
     }
 
+    // small per-transaction cursor cache backing Cursor::borrow()
+    MDB_cursor* acquire_cursor(Dbi dbi)
+    {
+        for (auto it = _cursors.begin(); it != _cursors.end(); ++it)
+        {
+            if (it->dbi != dbi)
+                continue;
+            CachedCursor c = *it;
+            _cursors.erase(it);
+            if (c.stale)
+            {
+                int rc = mdb_cursor_renew(_txn, c.cursor);
+                if (rc != 0)
+                    mdb_cursor_close(c.cursor);
+                check(rc);
+            }
+            return c.cursor;
+        }
+        MDB_cursor* cursor = nullptr;
+        check(mdb_cursor_open(_txn, dbi, &cursor));
+        return cursor;
+    }
+
+    void release_cursor(Dbi dbi, MDB_cursor* cursor)
+    {
+        // the txn already ended: a write txn's cursors went with it, a
+        // read-only one's have to be closed, neither is any use to cache
+        if (_txn == nullptr)
+        {
+            if (_rdonly)
+                mdb_cursor_close(cursor);
+            return;
+        }
+        if (_cursors.size() < max_cached_cursors)
+            _cursors.push_back({dbi, cursor, false});
+        else
+            mdb_cursor_close(cursor);
+    }
+
+    static constexpr size_t max_cached_cursors = 8;
+
+    // Keeps the dbi's filter and the change log in step with writes, called
+    // after each successful put/del. Writes made with raw mdb_put/mdb_del
+    // (or their cursor versions) have to call them too.
+    void note_put(Dbi dbi, MDB_val* key, MDB_val* val, unsigned int flags)
+    {
+        if (BloomFilter* f = _env->filter(dbi))
+            f->add(key);
+        ChangeLog* log = _env->change_log();
+        if (log == nullptr || !log->tracks(dbi))
+            return;
+        // the value is only written after this returns, it's logged at commit
+        if (flags & MDB_RESERVE)
+        {
+            _reserved.emplace_back(dbi, std::string{(const char*)key->mv_data, key->mv_size});
+            return;
+        }
+        if (flags & MDB_MULTIPLE)
+        {
+            // val[0] is the first of val[1].mv_size items of val[0].mv_size bytes
+            for (size_t i = 0; i < val[1].mv_size; ++i)
+            {
+                MDB_val item{val[0].mv_size, (char*)val[0].mv_data + i * val[0].mv_size};
+                check(log->append(_txn, ChangeOp::PUT, dbi, key, &item));
+            }
+            return;
+        }
+        check(log->append(_txn, ChangeOp::PUT, dbi, key, val));
+    }
+
+    // val is the one duplicate deleted, nullptr for the key with all of them
+    void note_del(Dbi dbi, MDB_val* key, MDB_val* val)
+    {
+        if (BloomFilter* f = _env->filter(dbi))
+            f->note_removed();
+        ChangeLog* log = _env->change_log();
+        if (log != nullptr && log->tracks(dbi))
+            check(log->append(_txn, val ? ChangeOp::DEL_DUP : ChangeOp::DEL, dbi, key, val));
+    }
+
+#undef TPL_K
 #undef TPL_KV
 #undef TPL_VK
 
-private:
-    void _put(MDB_dbi dbi, MDB_val* key, MDB_val* val, unsigned int flags) { check(mdb_put(_txn, dbi, key, val, flags)); }
-    void _del(MDB_dbi dbi, MDB_val* key, MDB_val* val) { check(mdb_del(_txn, dbi, key, val)); }
+protected:
+    // adopt an already running transaction, used by ReadTxn
+    struct Adopt {};
+    Txn(Adopt, Env& env, MDB_txn* txn)
+        : _txn(txn)
+        , _rdonly(true)
+        , _env(&env)
+    {
+        _pass_resize_gate();
+    }
+
+    // child of parent, which already holds a pass through the resize gate
+    Txn(Txn& parent, unsigned int flags)
+        : _env(parent._env)
+        , _autocommit(true)
+    {
+        _begin(parent._txn, flags);
+    }
+
+    void _begin(MDB_txn* parent, unsigned int flags)
+    {
+        {
+            metrics::Timer t{metrics::Op::TXN_BEGIN};
+            check(mdb_txn_begin(_env->mdb_env(), parent, flags, &_txn));
+        }
+        _rdonly = flags & MDB_RDONLY;
+        if (_rdonly)
+            _env->reader_ages().begin(_txn);
+    }
+
+    void _pass_resize_gate()
+    {
+        _resize_pass = ResizeGate::Pass{_env->resize_gate()};
+    }
+
+    void _close_cursors()
+    {
+        for (auto& c : _cursors)
+            mdb_cursor_close(c.cursor);
+        _cursors.clear();
+    }
+
     MDB_txn* _txn = nullptr;
-    Env& _env;
+    bool _rdonly = false;
+    std::vector<CachedCursor> _cursors;
+    ResizeGate::Pass _resize_pass;
+
+private:
+    // a key the dbi's filter rules out is reported missing without touching the map
+    int _get(MDB_dbi dbi, MDB_val* key, MDB_val* val)
+    {
+        metrics::Timer t{metrics::Op::GET};
+        if (BloomFilter* f = _env->filter(dbi); f != nullptr && f->covers(mdb_txn_id(_txn)) && !f->may_contain(key))
+            return MDB_NOTFOUND;
+        return mdb_get(_txn, dbi, key, val);
+    }
+    void _put(MDB_dbi dbi, MDB_val* key, MDB_val* val, unsigned int flags) { metrics::Timer t{metrics::Op::PUT}; check(mdb_put(_txn, dbi, key, val, flags)); note_put(dbi, key, val, flags); }
+    void _del(MDB_dbi dbi, MDB_val* key, MDB_val* val) { metrics::Timer t{metrics::Op::DEL}; check(mdb_del(_txn, dbi, key, val)); note_del(dbi, key, val); }
+
+    // logs the final value of keys written with MDB_RESERVE, unless deleted since
+    void _log_reserved()
+    {
+        ChangeLog* log = _env->change_log();
+        for (auto& [dbi, key] : _reserved)
+        {
+            MDB_val k{key.size(), key.data()}, v;
+            int rc = mdb_get(_txn, dbi, &k, &v);
+            if (rc == 0 && log != nullptr)
+                rc = log->append(_txn, ChangeOp::PUT, dbi, &k, &v);
+            if (rc != MDB_NOTFOUND)
+                check(rc);
+        }
+        _reserved.clear();
+    }
+
+    Env* _env;
     bool _autocommit = false;
+    std::vector<std::pair<Dbi, std::string>> _reserved;     // keys put with MDB_RESERVE, for the change log
+};
+
+// Read-only transaction whose write methods don't compile
+class ReadOnlyTxn : public Txn
+{
+public:
+    ReadOnlyTxn(Env& env) : Txn(env, MDB_RDONLY) {}
+
+    template <typename... Args> void put(Args&&...) = delete;
+    template <typename... Args> void overwrite(Args&&...) = delete;
+    template <typename... Args> void append(Args&&...) = delete;
+    template <typename... Args> void append_dup(Args&&...) = delete;
+    template <typename... Args> void reserve(Args&&...) = delete;
+    template <typename... Args> void reserve_overwrite(Args&&...) = delete;
+    template <typename... Args> void reserve_append(Args&&...) = delete;
+    template <typename... Args> void del(Args&&...) = delete;
+    void begin_nested() = delete;
+
+protected:
+    ReadOnlyTxn(Adopt, Env& env, MDB_txn* txn) : Txn(Adopt{}, env, txn) {}
+};
+
+// Read-write transaction, its children are WriteTxns as well
+class WriteTxn : public Txn
+{
+public:
+    WriteTxn(Env& env) : Txn(env) {}
+
+    WriteTxn(WriteTxn&&) = default;
+    WriteTxn& operator=(WriteTxn&&) = default;
+
+    WriteTxn begin_nested() { return WriteTxn{Nested{}, *this}; }
+
+private:
+    // tagged, a WriteTxn(WriteTxn&) would pass for a copy constructor
+    struct Nested {};
+    WriteTxn(Nested, WriteTxn& parent) : Txn(parent, 0) {}
 };
 
 
+// Runs fn(txn) in a write transaction and commits it, returning what fn returns.
+// On MapFullError everything is rolled back, the map grown (Env::grow()) and fn
+// run again; on MapResizedError the size another process set is adopted first.
+// Resizing waits for every transaction of the process to end: if one stays open
+// (on the calling thread, say) past EnvArgs::Growth::wait, the error is rethrown.
+template <typename TTxn = Txn, typename F>
+auto with_write_txn(Env& env, F&& fn)
+{
+    for (;;)
+    {
+        try
+        {
+            TTxn txn{env};
+            try
+            {
+                if constexpr (std::is_void_v<decltype(fn(txn))>)
+                {
+                    fn(txn);
+                    txn.commit();
+                    return;
+                }
+                else
+                {
+                    auto result = fn(txn);
+                    txn.commit();
+                    return result;
+                }
+            }
+            catch (...)
+            {
+                txn.abort();
+                throw;
+            }
+        }
+        catch (MapFullError&)
+        {
+            if (!env.grow())
+                throw;
+        }
+        catch (MapResizedError&)
+        {
+            if (!env.adopt_mapsize())
+                throw;
+        }
+    }
+}
+
+// Runs fn(txn) in a read-only transaction, retrying after adopting a map size
+// another process grew the map to (MapResizedError), see with_write_txn().
+template <typename F>
+auto with_read_txn(Env& env, F&& fn)
+{
+    for (;;)
+    {
+        try
+        {
+            Txn txn{env, MDB_RDONLY};
+            return fn(txn);
+        }
+        catch (MapResizedError&)
+        {
+            if (!env.adopt_mapsize())
+                throw;
+        }
+    }
+}
+
 }
 
 #endif
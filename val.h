@@ -75,8 +75,8 @@ public:
     Val(const char* str) : base_val<const char>(str, std::strlen(str)) {}
     Val(const std::string& str) : base_val<const char>(str.c_str(), str.length()) {}
     Val(const std::string_view& str) : base_val<const char>(str.data(), str.length()) {}
-    std::string to_str() { return std::string{data(), size()}; }
-    std::string_view to_strview() { return std::string_view{data(), size()}; }
+    std::string to_str() const { return std::string{data(), size()}; }
+    std::string_view to_strview() const { return std::string_view{data(), size()}; }
 };
 Val(const std::string& str) -> Val<const char>;
 Val(const std::string_view& str) -> Val<const char>;
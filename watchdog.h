@@ -0,0 +1,145 @@
+#ifndef __lmdbpp_watchdog_h
+#define __lmdbpp_watchdog_h
+
+#include <lmdb.h>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include <unistd.h>
+#include "lmdbpp.h"
+
+namespace lmdbpp
+{
+
+// a read-only transaction, of any process, over one of the watchdog's limits
+struct LongReader
+{
+    ReaderInfo reader;
+    std::chrono::nanoseconds age;   // since the watchdog first saw it, +- one interval
+    size_t lag;                     // write txns committed since its snapshot
+    bool own_process;
+};
+
+struct WatchdogArgs
+{
+    std::chrono::milliseconds interval{1000};
+    std::chrono::milliseconds max_age{30000};   // readers on the same snapshot longer than this are reported
+    size_t max_lag = 0;                         // readers this many txns behind are reported, 0 for no limit
+    // called once per offending transaction. Only the thread that owns a
+    // transaction may end it, so this is where to tell it to (or to kill a
+    // stuck worker process); the watchdog itself never touches it.
+    std::function<void(const LongReader&)> on_long_reader{};
+    std::function<void(int)> on_dead_readers{}; // slots freed by mdb_reader_check
+    std::function<void(std::exception_ptr)> on_error{};    // errors of the background rounds, callbacks' included
+};
+
+// Keeps page reuse healthy: every interval it frees the reader slots of
+// crashed processes (mdb_reader_check), then looks at every slot in the
+// reader table (mdb_reader_list) and reports transactions that have held the
+// same snapshot too long or fallen too far behind, since the pages they pin
+// make the map grow until MapFullError.
+class ReaderWatchdog
+{
+public:
+    ReaderWatchdog(Env& env, WatchdogArgs args = WatchdogArgs{})
+        : _env(env)
+        , _args(std::move(args))
+        , _thread([this] { _run(); })
+    {
+    }
+
+    ~ReaderWatchdog()
+    {
+        {
+            std::lock_guard lock{_mutex};
+            _stop = true;
+        }
+        _cv.notify_one();
+        _thread.join();
+    }
+
+    ReaderWatchdog(const ReaderWatchdog&) = delete;
+    ReaderWatchdog& operator=(const ReaderWatchdog&) = delete;
+
+    // one round of checks right away, returns every reader currently over a limit
+    std::vector<LongReader> check_now()
+    {
+        std::lock_guard lock{_check_mutex};
+        int dead = _env.reader_check();
+        if (dead > 0 && _args.on_dead_readers)
+            _args.on_dead_readers(dead);
+
+        auto now = clock::now();
+        size_t last_txnid = _env.info().me_last_txnid;
+        std::map<Slot, Seen> seen;
+        std::vector<LongReader> long_readers;
+        for (const ReaderInfo& r : _env.readers())
+        {
+            if (r.txnid == 0)
+                continue;
+            Slot slot{r.pid, r.thread, r.txnid};
+            auto it = _seen.find(slot);
+            Seen s = it != _seen.end() ? it->second : Seen{now, false};
+            LongReader lr{r, now - s.since, last_txnid - r.txnid, r.pid == _pid};
+            bool over = lr.age >= _args.max_age || (_args.max_lag > 0 && lr.lag >= _args.max_lag);
+            if (over)
+            {
+                long_readers.push_back(lr);
+                if (!s.reported && _args.on_long_reader)
+                    _args.on_long_reader(lr);
+                s.reported = true;
+            }
+            seen.emplace(slot, s);
+        }
+        // forget transactions that ended
+        _seen.swap(seen);
+        return long_readers;
+    }
+
+private:
+    typedef std::chrono::steady_clock clock;
+    typedef std::tuple<int, size_t, size_t> Slot;   // pid, thread, txnid
+
+    struct Seen
+    {
+        clock::time_point since;
+        bool reported;
+    };
+
+    void _run()
+    {
+        std::unique_lock lock{_mutex};
+        while (!_cv.wait_for(lock, _args.interval, [this] { return _stop; }))
+        {
+            lock.unlock();
+            try { check_now(); }
+            catch (...)
+            {
+                // try again next round
+                if (_args.on_error)
+                    _args.on_error(std::current_exception());
+            }
+            lock.lock();
+        }
+    }
+
+    Env& _env;
+    const WatchdogArgs _args;
+    const int _pid = ::getpid();
+    std::mutex _check_mutex;
+    std::map<Slot, Seen> _seen;
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    bool _stop = false;
+    std::thread _thread;
+};
+
+}  // namespace lmdbpp
+
+#endif
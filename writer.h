@@ -0,0 +1,398 @@
+#ifndef __lmdbpp_writer_h
+#define __lmdbpp_writer_h
+
+#include <lmdb.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "error.h"
+#include "env.h"
+#include "txn.h"
+#include "val.h"
+
+namespace lmdbpp
+{
+
+struct GroupCommitArgs
+{
+    size_t max_batch_ops = 4096;                    // ops per write transaction
+    size_t max_batch_bytes = 16 * 1024 * 1024;      // key+value bytes per write transaction
+    std::chrono::microseconds max_delay{500};       // how long the first op of a batch may wait for company
+    size_t nested_ops = 256;                        // ops per child transaction, see GroupCommitWriter, 0 for none
+};
+
+struct GroupCommitStats
+{
+    uint64_t ops = 0;               // ops completed, successfully or not
+    uint64_t failed_ops = 0;
+    uint64_t batches = 0;           // write transactions committed or aborted
+    uint64_t fsyncs = 0;            // commits made without MDB_NOSYNC
+    uint64_t max_batch_ops = 0;
+    uint64_t commit_ns = 0;         // total time spent in mdb_txn_commit
+    uint64_t max_commit_ns = 0;
+    uint64_t latency_ns = 0;        // total enqueue-to-completion time over all ops
+    uint64_t max_latency_ns = 0;
+
+    double avg_batch_ops() const { return batches ? (double)ops / batches : 0; }
+    double avg_latency_ns() const { return ops ? (double)latency_ns / ops : 0; }
+};
+
+// Funnels put/del operations from any number of threads into a single writer
+// thread, which applies them in batched write transactions. Each operation's
+// future is completed once the transaction covering it is committed, so many
+// writers share one commit (and one fsync).
+//
+// An op failing on its own (KeyExistsError on put, NotFoundError on del) only
+// fails that op's future. MapFullError is retried after Env::grow() when the
+// Env has a growth policy. Ops run in child transactions of nested_ops each:
+// any other error rolls back just that child, whose ops are then replayed one
+// by one so only the op at fault fails (not with MDB_WRITEMAP, which can't
+// nest, there it fails the batch).
+class GroupCommitWriter
+{
+public:
+    GroupCommitWriter(Env& env, GroupCommitArgs args = GroupCommitArgs{})
+        : _env(env)
+        , _args(args)
+        , _thread([this] { _run(); })
+    {
+    }
+
+    // applies everything still queued, then stops the writer thread
+    ~GroupCommitWriter()
+    {
+        {
+            std::lock_guard lock{_mutex};
+            _stop = true;
+        }
+        _cv.notify_one();
+        _thread.join();
+    }
+
+    GroupCommitWriter(const GroupCommitWriter&) = delete;
+    GroupCommitWriter& operator=(const GroupCommitWriter&) = delete;
+
+#define TPL_KV template <typename TKey, typename TVal>
+#define TPL_K template <typename TKey>
+
+    std::future<void> put(Dbi dbi, std::string_view key, std::string_view val) { return _enqueue(Op::PUT, dbi, key, val); }
+    std::future<void> overwrite(Dbi dbi, std::string_view key, std::string_view val) { return _enqueue(Op::OVERWRITE, dbi, key, val); }
+    std::future<void> del(Dbi dbi, std::string_view key) { return _enqueue(Op::DEL, dbi, key, {}); }
+    std::future<void> del(Dbi dbi, std::string_view key, std::string_view val) { return _enqueue(Op::DEL_DUP, dbi, key, val); }
+
+    TPL_KV std::future<void> put(Dbi dbi, const Val<TKey>& key, const Val<TVal>& val) { return put(dbi, _view(key), _view(val)); }
+    TPL_KV std::future<void> overwrite(Dbi dbi, const Val<TKey>& key, const Val<TVal>& val) { return overwrite(dbi, _view(key), _view(val)); }
+    TPL_KV std::future<void> del(Dbi dbi, const Val<TKey>& key, const Val<TVal>& val) { return del(dbi, _view(key), _view(val)); }
+    TPL_K std::future<void> del(Dbi dbi, const Val<TKey>& key) { return del(dbi, _view(key)); }
+
+#undef TPL_KV
+#undef TPL_K
+
+    // completes once everything queued before it is committed
+    std::future<void> flush() { return _enqueue(Op::FLUSH, 0, {}, {}); }
+
+    GroupCommitStats stats() const
+    {
+        GroupCommitStats s;
+        s.ops = _stats.ops;
+        s.failed_ops = _stats.failed_ops;
+        s.batches = _stats.batches;
+        s.fsyncs = _stats.fsyncs;
+        s.max_batch_ops = _stats.max_batch_ops;
+        s.commit_ns = _stats.commit_ns;
+        s.max_commit_ns = _stats.max_commit_ns;
+        s.latency_ns = _stats.latency_ns;
+        s.max_latency_ns = _stats.max_latency_ns;
+        return s;
+    }
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    struct Op
+    {
+        enum Kind { PUT, OVERWRITE, DEL, DEL_DUP, FLUSH };
+        Kind kind;
+        Dbi dbi;
+        std::string key;
+        std::string val;
+        clock::time_point enqueued;
+        std::promise<void> done;
+        std::exception_ptr error;
+    };
+
+    struct AtomicStats
+    {
+        std::atomic<uint64_t> ops{0};
+        std::atomic<uint64_t> failed_ops{0};
+        std::atomic<uint64_t> batches{0};
+        std::atomic<uint64_t> fsyncs{0};
+        std::atomic<uint64_t> max_batch_ops{0};
+        std::atomic<uint64_t> commit_ns{0};
+        std::atomic<uint64_t> max_commit_ns{0};
+        std::atomic<uint64_t> latency_ns{0};
+        std::atomic<uint64_t> max_latency_ns{0};
+    };
+
+    template <typename T>
+    static std::string_view _view(const Val<T>& v) { return {(const char*)v.data(), v.size()}; }
+
+    static void _max(std::atomic<uint64_t>& a, uint64_t v)
+    {
+        uint64_t cur = a.load(std::memory_order_relaxed);
+        while (cur < v && !a.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {}
+    }
+
+    static std::exception_ptr _error(int rc)
+    {
+        try { check(rc); }
+        catch (...) { return std::current_exception(); }
+        return nullptr;
+    }
+
+    std::future<void> _enqueue(Op::Kind kind, Dbi dbi, std::string_view key, std::string_view val)
+    {
+        Op op{kind, dbi, std::string{key}, std::string{val}, clock::now(), {}, nullptr};
+        auto future = op.done.get_future();
+        bool wake;
+        {
+            std::lock_guard lock{_mutex};
+            _pending_bytes += key.size() + val.size();
+            _pending.push_back(std::move(op));
+            wake = _pending.size() == 1 || _pending.size() >= _args.max_batch_ops || _pending_bytes >= _args.max_batch_bytes;
+        }
+        if (wake)
+            _cv.notify_one();
+        return future;
+    }
+
+    void _run()
+    {
+        std::vector<Op> batch;
+        std::unique_lock lock{_mutex};
+        for (;;)
+        {
+            _cv.wait(lock, [this] { return _stop || !_pending.empty(); });
+            if (_pending.empty())
+                return;
+
+            // give concurrent writers a moment to join the batch
+            auto deadline = _pending.front().enqueued + _args.max_delay;
+            _cv.wait_until(lock, deadline, [this]
+            {
+                return _stop || _pending.size() >= _args.max_batch_ops || _pending_bytes >= _args.max_batch_bytes;
+            });
+
+            batch.swap(_pending);
+            _pending_bytes = 0;
+            lock.unlock();
+
+            for (size_t begin = 0; begin < batch.size();)
+                begin = _apply(batch, begin);
+            batch.clear();
+
+            lock.lock();
+        }
+    }
+
+    // applies ops starting at `begin` in one write transaction, bounded by the
+    // batch limits, and returns the index of the first op not covered
+    size_t _apply(std::vector<Op>& batch, size_t begin)
+    {
+        size_t end = begin, writes = 0;
+        for (size_t bytes = 0; end < batch.size() && end - begin < _args.max_batch_ops && bytes < _args.max_batch_bytes; ++end)
+        {
+            bytes += batch[end].key.size() + batch[end].val.size();
+            if (batch[end].kind != Op::FLUSH)
+                ++writes;
+        }
+        // flush markers alone need no transaction, everything before them is committed
+        if (writes == 0)
+        {
+            for (size_t i = begin; i < end; ++i)
+                batch[i].done.set_value();
+            return end;
+        }
+
+        // with a growth policy on the Env a full map is grown and the batch retried
+        bool nested = _args.nested_ops > 0 && (_env.flags() & EnvArgs::Flags::WRITEMAP) == EnvArgs::Flags::NONE;
+        std::exception_ptr batch_error;
+        for (bool retry = true; retry;)
+        {
+            retry = false;
+            for (size_t i = begin; i < end; ++i)
+                batch[i].error = nullptr;
+            try
+            {
+                Txn txn{_env};
+                try
+                {
+                    if (nested)
+                    {
+                        for (size_t chunk = begin; chunk < end; chunk += _args.nested_ops)
+                            _apply_nested(txn, batch, chunk, std::min(end, chunk + _args.nested_ops));
+                    }
+                    else
+                    {
+                        for (size_t i = begin; i < end; ++i)
+                            _apply_op(txn, batch[i]);
+                    }
+                }
+                catch (...)
+                {
+                    txn.abort();
+                    throw;
+                }
+                auto start = clock::now();
+                txn.commit();
+                uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+                _stats.commit_ns += ns;
+                _max(_stats.max_commit_ns, ns);
+                if ((_env.flags() & EnvArgs::Flags::NOSYNC) == EnvArgs::Flags::NONE)
+                    ++_stats.fsyncs;
+            }
+            catch (MapFullError&)
+            {
+                retry = _env.grow();
+                if (!retry)
+                    batch_error = std::current_exception();
+            }
+            catch (MapResizedError&)
+            {
+                retry = _env.adopt_mapsize();
+                if (!retry)
+                    batch_error = std::current_exception();
+            }
+            catch (...)
+            {
+                batch_error = std::current_exception();
+            }
+        }
+
+        // stats first, so they already cover this batch when a future completes,
+        // flush markers aren't ops of their own
+        auto now = clock::now();
+        for (size_t i = begin; i < end; ++i)
+        {
+            Op& op = batch[i];
+            if (batch_error)
+                op.error = batch_error;
+            if (op.kind == Op::FLUSH)
+                continue;
+            if (op.error)
+                ++_stats.failed_ops;
+            uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - op.enqueued).count();
+            _stats.latency_ns += ns;
+            _max(_stats.max_latency_ns, ns);
+        }
+        _stats.ops += writes;
+        ++_stats.batches;
+        _max(_stats.max_batch_ops, writes);
+
+        for (size_t i = begin; i < end; ++i)
+        {
+            if (batch[i].error)
+                batch[i].done.set_exception(batch[i].error);
+            else
+                batch[i].done.set_value();
+        }
+        return end;
+    }
+
+    static void _apply_op(Txn& txn, Op& op)
+    {
+        MDB_val key{op.key.size(), op.key.data()};
+        MDB_val val{op.val.size(), op.val.data()};
+        int rc = 0;
+        switch (op.kind)
+        {
+            case Op::PUT:       rc = mdb_put(txn.mdb_txn(), op.dbi, &key, &val, MDB_NOOVERWRITE); break;
+            case Op::OVERWRITE: rc = mdb_put(txn.mdb_txn(), op.dbi, &key, &val, 0); break;
+            case Op::DEL:       rc = mdb_del(txn.mdb_txn(), op.dbi, &key, nullptr); break;
+            case Op::DEL_DUP:   rc = mdb_del(txn.mdb_txn(), op.dbi, &key, &val); break;
+            case Op::FLUSH:     break;
+        }
+        if (rc == MDB_KEYEXIST || rc == MDB_NOTFOUND)
+            op.error = _error(rc);
+        else
+            check(rc);
+        if (rc != 0)
+            return;
+        if (op.kind == Op::PUT || op.kind == Op::OVERWRITE)
+            txn.note_put(op.dbi, &key, &val, 0);
+        else if (op.kind != Op::FLUSH)
+            txn.note_del(op.dbi, &key, op.kind == Op::DEL_DUP ? &val : nullptr);
+    }
+
+    // runs fn(child) in a child of txn, committed on success and aborted on error
+    template <typename F>
+    static void _in_child(Txn& txn, F&& fn)
+    {
+        Txn child = txn.begin_nested();
+        try
+        {
+            fn(child);
+        }
+        catch (...)
+        {
+            child.abort();
+            throw;
+        }
+        child.commit();
+    }
+
+    // applies [begin, end) in a child transaction, on failure replays them one
+    // op per child so only the failing ops are rolled back. A full map still
+    // fails the whole transaction, growing it needs a fresh one.
+    static void _apply_nested(Txn& txn, std::vector<Op>& batch, size_t begin, size_t end)
+    {
+        try
+        {
+            _in_child(txn, [&](Txn& child)
+            {
+                for (size_t i = begin; i < end; ++i)
+                    _apply_op(child, batch[i]);
+            });
+            return;
+        }
+        catch (MapFullError&) { throw; }
+        catch (MapResizedError&) { throw; }
+        catch (...) {}
+
+        for (size_t i = begin; i < end; ++i)
+        {
+            batch[i].error = nullptr;
+            try
+            {
+                _in_child(txn, [&](Txn& child) { _apply_op(child, batch[i]); });
+            }
+            catch (MapFullError&) { throw; }
+            catch (MapResizedError&) { throw; }
+            catch (...)
+            {
+                batch[i].error = std::current_exception();
+            }
+        }
+    }
+
+    Env& _env;
+    const GroupCommitArgs _args;
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::vector<Op> _pending;
+    size_t _pending_bytes = 0;
+    bool _stop = false;
+    AtomicStats _stats;
+    std::thread _thread;
+};
+
+}  // namespace lmdbpp
+
+#endif